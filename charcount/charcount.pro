@@ -10,4 +10,12 @@ CONFIG -= app_bundle
 TEMPLATE = app
 
 SOURCES += main.cpp \
-    ../imageviewer/imageannotation.cpp
+    ../imageviewer/imageannotation.cpp \
+    ../imageviewer/annotationhistory.cpp \
+    ../imageviewer/annotationfile.cpp \
+    histogram.cpp
+
+HEADERS += \
+    histogram.h
+
+include(../datasetwalker/datasetwalker.pri)
@@ -0,0 +1,100 @@
+#include <QIODevice>
+#include <QDataStream>
+#include <QTextStream>
+#include <algorithm>
+#include "../imageviewer/imageannotation.h"
+#include "histogram.h"
+
+/// Histogram
+
+Histogram::Histogram(GroupBy groupBy)
+    : groupBy(groupBy) {
+}
+
+void Histogram::add(QString const &folder, QStringList const &texts, QByteArray const &props) {
+    Groups &groups(local());
+    if (groupBy != GROUP_PROPERTY) {
+        Table &table(groups[groupBy == GROUP_FOLDER ? folder : QString()]);
+        foreach (QString const &text, texts)
+            table[text]++;
+        return;
+    }
+    for (int i = 0; i < texts.size(); i++) {
+        quint8 bits = i < props.size() ? (quint8)props[i] : 0;
+        if (bits == 0)
+            groups["none"][texts[i]]++;
+        for (int id = 0; id < CharacterProps::NUM_IDS; id++)
+            if (bits & (1u << id))
+                groups[CharacterProps::nameOf(id)][texts[i]]++;
+    }
+}
+
+void Histogram::merge() {
+    foreach (QSharedPointer<Groups> const &groups, shards) {
+        for (Groups::const_iterator git = groups->constBegin(); git != groups->constEnd(); ++git) {
+            Table &table(merged[git.key()]);
+            for (Table::const_iterator it = git.value().constBegin(); it != git.value().constEnd(); ++it)
+                table[it.key()] += it.value();
+        }
+    }
+    shards.clear();
+}
+
+bool Histogram::writeTsv(QIODevice *out, int top) const {
+    QTextStream stream(out);
+    stream.setCodec("UTF-8");
+    QStringList names(merged.keys());
+    std::sort(names.begin(), names.end());
+    if (groupBy != GROUP_NONE)
+        stream << "group\t";
+    stream << "character\tcount\n";
+    foreach (QString const &name, names) {
+        QList<QPair<QString, qint64> > rows(sorted(merged[name], top));
+        for (int i = 0; i < rows.size(); i++) {
+            if (groupBy != GROUP_NONE)
+                stream << name << '\t';
+            stream << rows[i].first << '\t' << rows[i].second << '\n';
+        }
+    }
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
+
+bool Histogram::writeBinary(QIODevice *out, int top) const {
+    QDataStream stream(out);
+    stream.setVersion(QDataStream::Qt_5_2);
+    QStringList names(merged.keys());
+    std::sort(names.begin(), names.end());
+    stream << (quint32)MAGIC << (quint32)VERSION << (quint32)groupBy << (quint32)names.size();
+    foreach (QString const &name, names) {
+        QList<QPair<QString, qint64> > rows(sorted(merged[name], top));
+        stream << name << (quint32)rows.size();
+        for (int i = 0; i < rows.size(); i++)
+            stream << rows[i].first << rows[i].second;
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+Histogram::Groups &Histogram::local() {
+    if (!shard.hasLocalData()) {
+        QSharedPointer<Groups> groups(new Groups);
+        shard.setLocalData(groups);
+        QMutexLocker locker(&mutex);
+        shards.append(groups);
+    }
+    return *shard.localData();
+}
+
+QList<QPair<QString, qint64> > Histogram::sorted(Table const &table, int top) const {
+    QList<QPair<QString, qint64> > rows;
+    rows.reserve(table.size());
+    for (Table::const_iterator it = table.constBegin(); it != table.constEnd(); ++it)
+        rows.append(qMakePair(it.key(), it.value()));
+    // 次数相同时按字排序，输出与线程数无关
+    std::sort(rows.begin(), rows.end(), [](QPair<QString, qint64> const &a, QPair<QString, qint64> const &b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    if (top > 0 && rows.size() > top)
+        rows.erase(rows.begin() + top, rows.end());
+    return rows;
+}
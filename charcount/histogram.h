@@ -0,0 +1,55 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QMutex>
+#include <QThreadStorage>
+#include <QSharedPointer>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
+// 字频统计。工作线程各自计入自己的哈希表，不用加锁，全部处理完之后再合并
+class Histogram {
+public:
+    enum GroupBy {
+        GROUP_NONE,
+        GROUP_FOLDER,  // 按 .stream 所在的文件夹
+        GROUP_PROPERTY // 按字的属性，一个字有几个属性就计入几组，没有属性的字计入 "none"
+    };
+    enum { MAGIC = 0x43484953, VERSION = 1 };
+
+public:
+    explicit Histogram(GroupBy groupBy);
+
+    // 工作线程中调用；props[i] 是 texts[i] 的属性，第 id 位对应 CharacterProps::Id
+    void add(QString const &folder, QStringList const &texts, QByteArray const &props);
+    // 所有工作线程结束后调用
+    void merge();
+
+    // 每组按次数从多到少输出前 top 个字，top 为 0 时全部输出
+    bool writeTsv(QIODevice *out, int top) const;
+    bool writeBinary(QIODevice *out, int top) const;
+
+private:
+    typedef QHash<QString, qint64> Table;
+    typedef QHash<QString, Table> Groups;
+
+    Groups &local();
+    QList<QPair<QString, qint64> > sorted(Table const &table, int top) const;
+
+private:
+    GroupBy groupBy;
+    QMutex mutex; // 只在线程第一次计数时保护 shards
+    QList<QSharedPointer<Groups> > shards;
+    QThreadStorage<QSharedPointer<Groups> > shard;
+    Groups merged;
+};
+
+#endif // HISTOGRAM_H
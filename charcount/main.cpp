@@ -3,38 +3,24 @@
 #include <QDir>
 #include <QFile>
 #include <QDataStream>
+#include <QDateTime>
+#include <QHash>
+#include <QScopedPointer>
 #include <QDebug>
 #include <functional>
 #include "../imageviewer/imageannotation.h"
+#include "../imageviewer/annotationfile.h"
+#include "../datasetwalker/datasetwalker.h"
+#include "../datasetwalker/filecache.h"
+#include "histogram.h"
 
 static QTextStream cout(stdout);
 
-bool eachFile(QDir dir, std::function<bool(QString)> const &cb, QStringList const &nameFilters) {
-    if (!dir.exists()) {
-        cout << "directory not exists: " << dir.path() << endl;
-        return false;
-    }
-    dir.setFilter(QDir::Dirs | QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
-    dir.setNameFilters(nameFilters);
-    QFileInfoList list = dir.entryInfoList();
-    foreach (QFileInfo fileInfo, list) {
-        if (fileInfo.fileName() == "." || fileInfo.fileName() == "..")
-            continue;
-        if (fileInfo.isFile()) {
-            if (!cb(fileInfo.filePath()))
-                return false;
-        } else {
-            if (!eachFile(QDir(fileInfo.filePath()), cb, nameFilters))
-                return false;
-        }
-    }
-    return true;
-}
-
 class CharCounter {
 public:
     CharCounter() {
         top = 0;
+        numCounted = 0;
         Statistics::printTitle();
     }
     ~CharCounter() {
@@ -45,59 +31,6 @@ public:
         }
         total.print("", "Total", "");
     }
-    bool operator()(QString filePath) {
-        if (!filePath.endsWith(".stream"))
-            return true;
-        QFile file(filePath);
-        if (!file.open(QIODevice::ReadOnly)) {
-            cout << "open failed: " << file.fileName() << endl;
-            return false;
-        }
-        QDataStream st(&file);
-        ImageAnnotation anno;
-        st >> anno;
-        file.close();
-        if (st.status() != QDataStream::Ok) {
-            cout << "stream is bad: " << file.fileName() << endl;
-            return false;
-        }
-        Statistics stat;
-        stat.cnt = 1;
-        foreach (BlockAnnotation const &block, anno.blocks) {
-            bool hasMask = false;
-            bool hasNotMask = false;
-            foreach (CharacterAnnotation const &ch, block.characters) {
-                if (1 == ch.props.value("mask", 0)) {
-                    hasMask = true;
-                    continue;
-                }
-                if (ch.text.isEmpty())
-                    continue;
-                hasNotMask = true;
-                QString const &text = ch.text;
-                if (text == "*") {
-                    stat.numStar++;
-                } else {
-                    if (0 == ch.props.value("pass", 0))
-                        stat.numCharWithoutProps++;
-                    else
-                        stat.numCharWithProps++;
-                    if (bucket.find(text) == bucket.end())
-                        bucket[text] = 0;
-                    bucket[text]++;
-                }
-            }
-            if (hasMask)
-                stat.numMask++;
-            else if (hasNotMask)
-                stat.numBlkChar++;
-        }
-        QFileInfo fileInfo(file.fileName());
-        QString dirName = fileInfo.dir().path();
-        stat.print(QString("%1").arg(++top), fileInfo.completeBaseName(), dirName);
-        folderStat[dirName] = folderStat[dirName] + stat;
-        return true;
-    }
 private:
     CharCounter(CharCounter const &);
     struct Statistics {
@@ -135,8 +68,164 @@ private:
                     arg(folder) << endl;
         }
     };
+
+public:
+    // 缓存中一个文件的统计结果；文件的修改时间或大小变了就重新统计
+    struct Cached {
+        Statistics stat;
+        QStringList texts;
+        QByteArray props;
+
+        friend QDataStream &operator <<(QDataStream &stream, Cached const &cached) {
+            Statistics const &stat(cached.stat);
+            stream << stat.cnt << stat.numBlkChar << stat.numCharWithProps << stat.numCharWithoutProps
+                   << stat.numStar << stat.numMask << cached.texts << cached.props;
+            return stream;
+        }
+        friend QDataStream &operator >>(QDataStream &stream, Cached &cached) {
+            Statistics &stat(cached.stat);
+            stream >> stat.cnt >> stat.numBlkChar >> stat.numCharWithProps >> stat.numCharWithoutProps
+                   >> stat.numStar >> stat.numMask >> cached.texts >> cached.props;
+            return stream;
+        }
+    };
+
+    class Cache : public FileCache<Cached> {
+    public:
+        enum { MAGIC = 0x43434e54, VERSION = 2 };
+
+        Cache() : FileCache<Cached>(MAGIC, VERSION) {}
+    };
+
+    // 一个文件的统计结果，在工作线程中算出
+    struct Counted {
+        Counted() : skipped(false), cached(false), lastModified(0), fileSize(-1) {}
+        bool skipped;
+        bool cached;                // 结果来自缓存
+        QString error;
+        Statistics stat;
+        QStringList texts;
+        QByteArray props;           // 每个字一个字节，第 id 位是 CharacterProps::Id 的取值
+        qint64 lastModified;
+        qint64 fileSize;
+    };
+
+    // histogram 不为空时同时统计字频
+    static Counted count(QString const &filePath, Cache const *cache, Histogram *histogram) {
+        Counted res(countFile(filePath, cache));
+        if (histogram && !res.skipped && res.error.isEmpty())
+            histogram->add(QFileInfo(filePath).dir().path(), res.texts, res.props);
+        return res;
+    }
+
+private:
+    static Counted countFile(QString const &filePath, Cache const *cache) {
+        Counted res;
+        if (!filePath.endsWith(".stream")) {
+            res.skipped = true;
+            return res;
+        }
+        QFile file(filePath);
+        if (!file.exists()) {
+            res.error = "open failed: " + file.fileName();
+            return res;
+        }
+        QFileInfo fileInfo(file);
+        res.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+        res.fileSize = fileInfo.size();
+        Cached cached;
+        if (cache && cache->lookup(fileInfo, cached)) {
+            res.cached = true;
+            res.stat = cached.stat;
+            res.texts = cached.texts;
+            res.props = cached.props;
+            return res;
+        }
+        ImageAnnotation anno;
+        if (!AnnotationFile::readAnnotation(filePath, anno)) {
+            res.error = "stream is bad: " + file.fileName();
+            return res;
+        }
+        Statistics &stat(res.stat);
+        stat.cnt = 1;
+        foreach (BlockAnnotation const &block, anno.blocks) {
+            bool hasMask = false;
+            bool hasNotMask = false;
+            foreach (CharacterAnnotation const &ch, block.characters) {
+                if (1 == ch.props.value(CharacterProps::MASK)) {
+                    hasMask = true;
+                    continue;
+                }
+                if (ch.text.isEmpty())
+                    continue;
+                hasNotMask = true;
+                QString const &text = ch.text;
+                if (text == "*") {
+                    stat.numStar++;
+                } else {
+                    if (0 == ch.props.value(CharacterProps::PASS))
+                        stat.numCharWithoutProps++;
+                    else
+                        stat.numCharWithProps++;
+                    res.texts.append(text);
+                    res.props.append(propBits(ch.props));
+                }
+            }
+            if (hasMask)
+                stat.numMask++;
+            else if (hasNotMask)
+                stat.numBlkChar++;
+        }
+        return res;
+    }
+
+    static char propBits(CharacterProps const &props) {
+        quint8 bits = 0;
+        for (int id = 0; id < CharacterProps::NUM_IDS; id++)
+            if (1 == props.value(static_cast<CharacterProps::Id>(id)))
+                bits |= 1u << id;
+        return (char)bits;
+    }
+
+public:
+    // 在主线程中按文件顺序输出和汇总
+    bool operator()(QString const &filePath, Counted const &res) {
+        if (res.skipped)
+            return true;
+        if (!res.error.isEmpty()) {
+            cout << res.error << endl;
+            return false;
+        }
+        QFileInfo fileInfo(filePath);
+        QString dirName = fileInfo.dir().path();
+        res.stat.print(QString("%1").arg(++top), fileInfo.completeBaseName(), dirName);
+        folderStat[dirName] = folderStat[dirName] + res.stat;
+        Cache::Entry entry;
+        entry.lastModified = res.lastModified;
+        entry.fileSize = res.fileSize;
+        entry.value.stat = res.stat;
+        entry.value.texts = res.texts;
+        entry.value.props = res.props;
+        seen.insert(fileInfo.absoluteFilePath(), entry);
+        if (!res.cached)
+            numCounted++;
+        return true;
+    }
+
+    // 用这次遇到的文件替换缓存，已删除的文件随之去掉；没有变化时返回 false
+    bool updateCache(Cache &cache) const {
+        if (numCounted == 0 && seen.size() == cache.size())
+            return false;
+        cache.clear();
+        for (QHash<QString, Cache::Entry>::const_iterator it = seen.constBegin(); it != seen.constEnd(); ++it)
+            cache.insert(it.key(), it.value());
+        return true;
+    }
+
+private:
+    QHash<QString, Cache::Entry> seen;
+    int numCounted; // 没有命中缓存、重新统计的文件数
     int top;
-    QMap<QString, int> bucket;
     QMap<QString, Statistics> folderStat;
 };
 
@@ -145,6 +234,18 @@ int main(int argc, char *argv[]) {
     app.setApplicationVersion("v0.0.1");
 
     QCommandLineParser parser;
+    QCommandLineOption cacheOption("cache", "Cache of per-file statistics. Default: .charcount.cache in the folder.", "file");
+    QCommandLineOption noCacheOption("no-cache", "Count every file and do not write the cache.");
+    QCommandLineOption histogramOption("histogram", "Write character frequencies to <file>.", "file");
+    QCommandLineOption topOption("top", "Only the <k> most frequent characters of each group. Default: all.", "k", "0");
+    QCommandLineOption groupByOption("group-by", "Group frequencies by none, folder or property.", "group", "none");
+    QCommandLineOption histogramFormatOption("histogram-format", "Histogram format: tsv or binary.", "format", "tsv");
+    parser.addOption(cacheOption);
+    parser.addOption(noCacheOption);
+    parser.addOption(histogramOption);
+    parser.addOption(topOption);
+    parser.addOption(groupByOption);
+    parser.addOption(histogramFormatOption);
     parser.process(app);
     const QStringList args = parser.positionalArguments();
     if (args.size() < 1) {
@@ -153,13 +254,75 @@ int main(int argc, char *argv[]) {
     }
     QDir rootDir(args[0]);
 
+    QScopedPointer<Histogram> histogram;
+    QFile histogramFile(parser.value(histogramOption));
+    bool topOk = false;
+    int top = parser.value(topOption).toInt(&topOk);
+    QString groupBy = parser.value(groupByOption);
+    QString histogramFormat = parser.value(histogramFormatOption);
+    if (!topOk || top < 0) {
+        cout << "bad top: " << parser.value(topOption) << endl;
+        return 1;
+    }
+    if (groupBy != "none" && groupBy != "folder" && groupBy != "property") {
+        cout << "unknown group: " << groupBy << endl;
+        return 1;
+    }
+    if (histogramFormat != "tsv" && histogramFormat != "binary") {
+        cout << "unknown histogram format: " << histogramFormat << endl;
+        return 1;
+    }
+    if (parser.isSet(histogramOption)) {
+        if (!histogramFile.open(QIODevice::WriteOnly)) {
+            cout << "cannot write " << histogramFile.fileName() << endl;
+            return 1;
+        }
+        histogram.reset(new Histogram(groupBy == "folder" ? Histogram::GROUP_FOLDER
+                                      : groupBy == "property" ? Histogram::GROUP_PROPERTY
+                                      : Histogram::GROUP_NONE));
+    }
+
+    CharCounter::Cache cache;
+    QString cacheFile;
+    if (!parser.isSet(noCacheOption)) {
+        cacheFile = parser.isSet(cacheOption) ? parser.value(cacheOption) : rootDir.filePath(".charcount.cache");
+        cache.load(cacheFile);
+    }
+    CharCounter::Cache const *lookup = cacheFile.isEmpty() ? nullptr : &cache;
+
     CharCounter charCounter;
     QStringList nameFilters;
     nameFilters << "*.stream";
-    std::function<bool(QString)> cb([&](QString filePath) {
-        return charCounter(filePath);
+    DatasetWalker walker;
+    QStringList files;
+    bool listed = walker.listFiles(rootDir, nameFilters, files);
+    Histogram *hist = histogram.data();
+    std::function<CharCounter::Counted(QString const &)> count([lookup, hist](QString const &filePath) {
+        return CharCounter::count(filePath, lookup, hist);
+    });
+    std::function<bool(QString const &, CharCounter::Counted const &)> sum(
+                [&](QString const &filePath, CharCounter::Counted const &res) {
+        return charCounter(filePath, res);
     });
-    if (!eachFile(rootDir, cb, nameFilters)) {
+    bool ok = walker.mapReduce(files, count, sum);
+    if (ok && !listed) {
+        cout << walker.errorString() << endl;
+        ok = false;
+    }
+    // 出错时只列出了部分文件，不能据此删去缓存中的其他文件
+    if (ok && !cacheFile.isEmpty() && charCounter.updateCache(cache) && !cache.save(cacheFile))
+        cout << "cannot write " << cacheFile << endl;
+    if (ok && histogram) {
+        // mapReduce 返回时工作线程都已结束
+        histogram->merge();
+        bool written = histogramFormat == "binary" ? histogram->writeBinary(&histogramFile, top)
+                                                   : histogram->writeTsv(&histogramFile, top);
+        if (!written) {
+            cout << "cannot write " << histogramFile.fileName() << endl;
+            ok = false;
+        }
+    }
+    if (!ok) {
         cout << "error occurred" << endl;
         return 1;
     }
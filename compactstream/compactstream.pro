@@ -0,0 +1,17 @@
+QT += core
+# QT -= gui
+
+CONFIG += c++11
+
+TARGET = compactstream
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    ../imageviewer/imageannotation.cpp \
+    ../imageviewer/annotationhistory.cpp \
+    ../imageviewer/annotationfile.cpp
+
+include(../datasetwalker/datasetwalker.pri)
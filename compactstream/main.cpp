@@ -0,0 +1,78 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <functional>
+#include "../imageviewer/imageannotation.h"
+#include "../imageviewer/annotationfile.h"
+#include "../datasetwalker/datasetwalker.h"
+
+static QTextStream cout(stdout);
+
+struct Compacted {
+    Compacted() : ok(false), sizeBefore(0), sizeAfter(0) {}
+    bool ok;
+    QString errorMessage;
+    qint64 sizeBefore;
+    qint64 sizeAfter;
+};
+
+// 把追加了记录的 .stream 日志整体重写为只有基础快照的文件，旧格式的文件也会转换为日志格式
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationVersion("v0.0.1");
+
+    QCommandLineParser parser;
+    parser.process(app);
+    const QStringList args = parser.positionalArguments();
+    if (args.size() < 1) {
+        cout << "missing parameter: folder path" << endl;
+        return 1;
+    }
+    QDir rootDir(args[0]);
+
+    int numFile = 0;
+    qint64 sizeBefore = 0, sizeAfter = 0;
+    QStringList nameFilters;
+    nameFilters << "*.stream";
+    DatasetWalker walker;
+    QStringList files;
+    bool listed = walker.listFiles(rootDir, nameFilters, files);
+    // 各文件互不相关，在工作线程中压缩，按文件顺序汇总
+    std::function<Compacted(QString const &)> compact([](QString const &filePath) {
+        Compacted res;
+        if (!filePath.endsWith(".stream")) {
+            res.ok = true;
+            return res;
+        }
+        res.sizeBefore = QFileInfo(filePath).size();
+        res.ok = AnnotationFile::compact(filePath, &res.errorMessage);
+        res.sizeAfter = QFileInfo(filePath).size();
+        return res;
+    });
+    std::function<bool(QString const &, Compacted const &)> sum([&](QString const &filePath, Compacted const &res) {
+        if (!filePath.endsWith(".stream"))
+            return true;
+        if (!res.ok) {
+            cout << "compact failed: " << res.errorMessage << endl;
+            return false;
+        }
+        numFile++;
+        sizeBefore += res.sizeBefore;
+        sizeAfter += res.sizeAfter;
+        return true;
+    });
+    bool ok = walker.mapReduce(files, compact, sum);
+    if (ok && !listed) {
+        cout << walker.errorString() << endl;
+        ok = false;
+    }
+    if (!ok) {
+        cout << "error occurred" << endl;
+        return 1;
+    }
+    cout << numFile << " files, " << sizeBefore << " -> " << sizeAfter << " bytes" << endl;
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <QtEndian>
+#include <cstring>
+#include "cborwriter.h"
+
+/// CborWriter
+
+CborWriter::CborWriter(QByteArray &buffer)
+    : buffer(buffer) {
+}
+
+void CborWriter::beginObject() {
+    buffer += (char)0xbf;
+}
+
+void CborWriter::endObject() {
+    buffer += (char)0xff;
+}
+
+void CborWriter::beginArray() {
+    buffer += (char)0x9f;
+}
+
+void CborWriter::endArray() {
+    buffer += (char)0xff;
+}
+
+void CborWriter::key(char const *name) {
+    int length = (int)strlen(name);
+    head(3, length);
+    buffer.append(name, length);
+}
+
+void CborWriter::value(double d) {
+    buffer += (char)0xfb;
+    quint64 bits;
+    memcpy(&bits, &d, sizeof(bits));
+    char be[8];
+    qToBigEndian(bits, (uchar *)be);
+    buffer.append(be, 8);
+}
+
+void CborWriter::value(int i) {
+    value((qint64)i);
+}
+
+void CborWriter::value(qint64 i) {
+    if (i >= 0)
+        head(0, i);
+    else
+        head(1, -1 - i);
+}
+
+void CborWriter::value(bool b) {
+    buffer += (char)(b ? 0xf5 : 0xf4);
+}
+
+void CborWriter::value(QString const &s) {
+    QByteArray utf8 = s.toUtf8();
+    head(3, utf8.size());
+    buffer += utf8;
+}
+
+void CborWriter::raw(QByteArray const &cbor) {
+    buffer += cbor;
+}
+
+void CborWriter::floatArray(float const *values, int count) {
+    head(6, TAG_FLOAT32_LE);
+    head(2, count * 4);
+    for (int i = 0; i < count; i++) {
+        quint32 bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        char le[4];
+        qToLittleEndian(bits, (uchar *)le);
+        buffer.append(le, 4);
+    }
+}
+
+void CborWriter::beginArray(int count) {
+    head(4, count);
+}
+
+void CborWriter::head(quint8 major, quint64 n) {
+    major <<= 5;
+    if (n < 24) {
+        buffer += (char)(major | n);
+    } else if (n <= 0xff) {
+        buffer += (char)(major | 24);
+        buffer += (char)n;
+    } else if (n <= 0xffff) {
+        char be[2];
+        qToBigEndian((quint16)n, (uchar *)be);
+        buffer += (char)(major | 25);
+        buffer.append(be, 2);
+    } else if (n <= 0xffffffffULL) {
+        char be[4];
+        qToBigEndian((quint32)n, (uchar *)be);
+        buffer += (char)(major | 26);
+        buffer.append(be, 4);
+    } else {
+        char be[8];
+        qToBigEndian(n, (uchar *)be);
+        buffer += (char)(major | 27);
+        buffer.append(be, 8);
+    }
+}
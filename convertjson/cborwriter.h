@@ -0,0 +1,41 @@
+#ifndef CBORWRITER_H
+#define CBORWRITER_H
+
+#include <QByteArray>
+#include <QString>
+
+// 把 CBOR（RFC 7049）追加到 buffer 中，接口与 JsonWriter 相同，
+// 对象和数组用不定长编码，写之前不需要知道元素个数。
+// 坐标用 RFC 8746 的 float32 小端类型化数组（tag 85）打包，读取时不用逐个解析数字
+class CborWriter {
+public:
+    enum { TAG_FLOAT32_LE = 85 };
+
+public:
+    explicit CborWriter(QByteArray &buffer);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key(char const *name);
+
+    void value(double d);
+    void value(int i);
+    void value(qint64 i);
+    void value(bool b);
+    void value(QString const &s);
+    // 写入另一个 CborWriter 生成的完整的值
+    void raw(QByteArray const &cbor);
+    void floatArray(float const *values, int count);
+    // 定长的数组，之后须写入 count 个值
+    void beginArray(int count);
+
+private:
+    void head(quint8 major, quint64 n);
+
+private:
+    QByteArray &buffer;
+};
+
+#endif // CBORWRITER_H
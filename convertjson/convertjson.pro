@@ -10,4 +10,16 @@ CONFIG -= app_bundle
 TEMPLATE = app
 
 SOURCES += main.cpp \
-    ../imageviewer/imageannotation.cpp
+    ../imageviewer/imageannotation.cpp \
+    ../imageviewer/annotationhistory.cpp \
+    ../imageviewer/annotationfile.cpp \
+    jsonwriter.cpp \
+    cborwriter.cpp \
+    imagesizecache.cpp
+
+HEADERS += \
+    jsonwriter.h \
+    cborwriter.h \
+    imagesizecache.h
+
+include(../datasetwalker/datasetwalker.pri)
@@ -0,0 +1,13 @@
+#include <QImageReader>
+#include "imagesizecache.h"
+
+/// ImageSizeCache
+
+bool ImageSizeCache::probe(QFileInfo const &fileInfo, Entry &entry) {
+    QImageReader reader(fileInfo.absoluteFilePath());
+    QSize size = reader.size();
+    if (!size.isValid())
+        return false;
+    entry = entryOf(fileInfo, size);
+    return true;
+}
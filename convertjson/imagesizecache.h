@@ -0,0 +1,19 @@
+#ifndef IMAGESIZECACHE_H
+#define IMAGESIZECACHE_H
+
+#include <QSize>
+#include "../datasetwalker/filecache.h"
+
+// 图片尺寸的持久缓存。缓存未命中时只读图片文件头取尺寸，不解码像素
+class ImageSizeCache : public FileCache<QSize> {
+public:
+    enum { MAGIC = 0x494d535a, VERSION = 1 };
+
+public:
+    ImageSizeCache() : FileCache<QSize>(MAGIC, VERSION) {}
+
+    // 读取文件头得到尺寸，失败时返回 false
+    static bool probe(QFileInfo const &fileInfo, Entry &entry);
+};
+
+#endif // IMAGESIZECACHE_H
@@ -0,0 +1,132 @@
+#include <QtNumeric>
+#include <QLocale>
+#include <limits>
+#include "jsonwriter.h"
+
+/// JsonWriter
+
+JsonWriter::JsonWriter(QByteArray &buffer)
+    : buffer(buffer), afterKey(false) {
+}
+
+void JsonWriter::beginObject() {
+    separate();
+    buffer += '{';
+    first.append(true);
+}
+
+void JsonWriter::endObject() {
+    buffer += '}';
+    first.removeLast();
+}
+
+void JsonWriter::beginArray() {
+    separate();
+    buffer += '[';
+    first.append(true);
+}
+
+void JsonWriter::endArray() {
+    buffer += ']';
+    first.removeLast();
+}
+
+void JsonWriter::key(char const *name) {
+    separate();
+    buffer += '"';
+    buffer += name;
+    buffer += "\":";
+    afterKey = true;
+}
+
+void JsonWriter::value(double d) {
+    separate();
+    // 同 Qt 的 qjsonwriter.cpp
+    if (qIsFinite(d))
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
+        buffer += QByteArray::number(d, 'g', QLocale::FloatingPointShortest);
+#else
+        buffer += QByteArray::number(d, 'g', std::numeric_limits<double>::digits10 + 2);
+#endif
+    else
+        buffer += "null";
+}
+
+void JsonWriter::value(int i) {
+    // QJsonValue 中整数也按 double 保存
+    value((double)i);
+}
+
+void JsonWriter::value(bool b) {
+    separate();
+    buffer += b ? "true" : "false";
+}
+
+void JsonWriter::value(QString const &s) {
+    separate();
+    buffer += '"';
+    escape(s);
+    buffer += '"';
+}
+
+void JsonWriter::raw(QByteArray const &json) {
+    separate();
+    buffer += json;
+}
+
+void JsonWriter::separate() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (first.isEmpty())
+        return;
+    if (first.last())
+        first.last() = false;
+    else
+        buffer += ',';
+}
+
+void JsonWriter::escape(QString const &s) {
+    static char const hexdig[] = "0123456789abcdef";
+    ushort const *src = s.utf16();
+    ushort const *end = src + s.length();
+    while (src != end) {
+        ushort u = *src++;
+        if (u < 0x80) {
+            if (u < 0x20 || u == 0x22 || u == 0x5c) {
+                buffer += '\\';
+                switch (u) {
+                case 0x22: buffer += '"'; break;
+                case 0x5c: buffer += '\\'; break;
+                case 0x8: buffer += 'b'; break;
+                case 0xc: buffer += 'f'; break;
+                case 0xa: buffer += 'n'; break;
+                case 0xd: buffer += 'r'; break;
+                case 0x9: buffer += 't'; break;
+                default:
+                    buffer += "u00";
+                    buffer += hexdig[u >> 4];
+                    buffer += hexdig[u & 0xf];
+                }
+            } else {
+                buffer += (char)u;
+            }
+        } else if (u < 0x800) {
+            buffer += (char)(0xc0 | (u >> 6));
+            buffer += (char)(0x80 | (u & 0x3f));
+        } else if (QChar::isHighSurrogate(u) && src != end && QChar::isLowSurrogate(*src)) {
+            uint ucs4 = QChar::surrogateToUcs4(u, *src++);
+            buffer += (char)(0xf0 | (ucs4 >> 18));
+            buffer += (char)(0x80 | ((ucs4 >> 12) & 0x3f));
+            buffer += (char)(0x80 | ((ucs4 >> 6) & 0x3f));
+            buffer += (char)(0x80 | (ucs4 & 0x3f));
+        } else if (QChar::isSurrogate(u)) {
+            buffer += '?'; // 不成对的代理项，Qt 也写成 '?'
+        } else {
+            buffer += (char)(0xe0 | (u >> 12));
+            buffer += (char)(0x80 | ((u >> 6) & 0x3f));
+            buffer += (char)(0x80 | (u & 0x3f));
+        }
+    }
+}
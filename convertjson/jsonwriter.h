@@ -0,0 +1,39 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVarLengthArray>
+
+// 不建 QJsonObject 树，直接把紧凑格式的 JSON 追加到 buffer 中。
+// 输出与 QJsonDocument::toJson(QJsonDocument::Compact) 逐字节相同：
+// 数字、字符串的转义都按 Qt 的写法；对象的键须由调用者按升序写出，与 QJsonObject 的顺序一致
+class JsonWriter {
+public:
+    explicit JsonWriter(QByteArray &buffer);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    // 键只能是不需要转义的 ASCII 字符串
+    void key(char const *name);
+
+    void value(double d);
+    void value(int i);
+    void value(bool b);
+    void value(QString const &s);
+    // 写入另一个 JsonWriter 生成的完整的值
+    void raw(QByteArray const &json);
+
+private:
+    void separate();
+    void escape(QString const &s);
+
+private:
+    QByteArray &buffer;
+    QVarLengthArray<bool, 16> first; // 每一层是否还没有写过元素
+    bool afterKey;
+};
+
+#endif // JSONWRITER_H
@@ -1,89 +1,73 @@
 #include <QCoreApplication>
 #include <QCommandLineParser>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
 #include <QDir>
 #include <QFile>
 #include <QDataStream>
+#include <QVarLengthArray>
 #include <QDebug>
 #include <functional>
 #include <stdexcept>
+#include <exception>
 #include "../imageviewer/imageannotation.h"
+#include "../imageviewer/quad.h"
+#include "../imageviewer/annotationfile.h"
+#include "../datasetwalker/datasetwalker.h"
+#include "jsonwriter.h"
+#include "cborwriter.h"
+#include "imagesizecache.h"
 
 static QTextStream cin(stdin);
-static QTextStream cout(stdout);
 static QTextStream cerr(stderr);
 
-bool eachFile(QDir dir, std::function<bool(QString)> const &cb, QStringList const &nameFilters) {
-    if (!dir.exists()) {
-        cerr << "directory not exists: " << dir.path() << endl;
-        return false;
-    }
-    dir.setFilter(QDir::Dirs | QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
-    dir.setNameFilters(nameFilters);
-    QFileInfoList list = dir.entryInfoList();
-    foreach (QFileInfo fileInfo, list) {
-        if (fileInfo.fileName() == "." || fileInfo.fileName() == "..")
-            continue;
-        if (fileInfo.isFile()) {
-            if (!cb(fileInfo.filePath()))
-                return false;
-        } else {
-            if (!eachFile(QDir(fileInfo.filePath()), cb, nameFilters))
-                return false;
-        }
+void writePoly(JsonWriter &json, QPolygonF const &poly) {
+    json.beginArray();
+    foreach (QPointF const &p, poly) {
+        json.beginArray();
+        json.value(p.x());
+        json.value(p.y());
+        json.endArray();
     }
-    return true;
+    json.endArray();
 }
 
-QJsonArray poly2json(QPolygonF const &poly) {
-    QJsonArray res;
-    foreach (QPointF const &p, poly) {
-        QJsonArray xy;
-        xy.append(p.x());
-        xy.append(p.y());
-        res.append(xy);
-    }
-    return res;
+void writeRect(JsonWriter &json, QRectF const &rect) {
+    json.beginArray();
+    json.value(rect.x());
+    json.value(rect.y());
+    json.value(rect.width());
+    json.value(rect.height());
+    json.endArray();
 }
 
-QJsonArray poly2bbox(QPolygonF const &poly) {
-    if (poly.size() == 0)
-        return {0, 0, 0, 0};
-    qreal xmin = poly[0].x(), ymin = poly[0].y();
-    qreal xmax = xmin, ymax = ymin;
+// CBOR 中坐标打包成 float32 数组，多边形是展平的 [x0, y0, x1, y1, ...]
+void writePoly(CborWriter &cbor, QPolygonF const &poly) {
+    QVarLengthArray<float, 8> values;
     foreach (QPointF const &p, poly) {
-        xmin = qMin(xmin, p.x());
-        xmax = qMax(xmax, p.x());
-        ymin = qMin(ymin, p.y());
-        ymax = qMax(ymax, p.y());
+        values.append((float)p.x());
+        values.append((float)p.y());
     }
-    return {xmin, ymin, xmax - xmin, ymax - ymin};
+    cbor.floatArray(values.constData(), values.size());
 }
 
-QJsonArray poly2adjustedbbox(QPolygonF const &poly) {
-    if (poly.size() == 0)
-        return {0, 0, 0, 0};
-    qreal xmin = 0, xmax = 0, ymin = 0, ymax = 0;
-    for (int i = 0; i < poly.size(); i++) {
-        QPointF const &p1(poly[i]);
-        QPointF const &p2(poly[(i + 1) % poly.size()]);
-        for (int j = 1; j < 3; j++) {
-            QPointF q = p1 * j / 3 + p2 * (3 - j) / 3;
-            if (i == 0 && j == 1) {
-                xmin = xmax = q.x();
-                ymin = ymax = q.y();
-            } else {
-                xmin = qMin(xmin, q.x());
-                xmax = qMax(xmax, q.x());
-                ymin = qMin(ymin, q.y());
-                ymax = qMax(ymax, q.y());
-            }
-        }
+void writeRect(CborWriter &cbor, QRectF const &rect) {
+    float values[4] = {(float)rect.x(), (float)rect.y(), (float)rect.width(), (float)rect.height()};
+    cbor.floatArray(values, 4);
+}
 
-    }
-    return {xmin, ymin, xmax - xmin, ymax - ymin};
+QRectF polyBBox(QPolygonF const &poly) {
+    if (Quad::isQuad(poly))
+        return Quad(poly).boundingRect();
+    return poly.boundingRect();
+}
+
+template <typename Writer>
+void writeMask(Writer &json, QPolygonF const &poly) {
+    json.beginObject();
+    json.key("bbox");
+    writeRect(json, polyBBox(poly));
+    json.key("polygon");
+    writePoly(json, poly);
+    json.endObject();
 }
 
 bool isChinese(QString const &text) {
@@ -95,36 +79,56 @@ bool isChinese(QString const &text) {
     return flag;
 }
 
-QJsonObject character2json(CharacterAnnotation const &charAnno) {
+template <typename Writer>
+void writeCharacter(Writer &json, CharacterAnnotation const &charAnno) {
     if (ImageAnnotation::VERSION != 0x1002)
         throw std::invalid_argument("ImageAnnotation::VERSION != 0x1002");
     if (charAnno.box.size() != 4)
         throw std::invalid_argument("charAnno.box.size() != 4");
     if (charAnno.text.length() != 1)
         throw std::invalid_argument("charAnno.text.length() != 1");
-    QJsonObject res;
-    res["polygon"] = poly2json(charAnno.box);
-    res["adjusted_bbox"] = poly2adjustedbbox(charAnno.box);
-    res["text"] = charAnno.text;
-    res["is_chinese"] = isChinese(charAnno.text);
-    QVector<QString> props;
-    if (1 == charAnno.props.value("covered", 0)) props.append("occluded");
-    if (1 == charAnno.props.value("bgcomplex", 0)) props.append("bgcomplex");
-    if (1 == charAnno.props.value("raised", 0)) props.append("distorted");
-    if (1 == charAnno.props.value("perspective", 0)) props.append("raised");
-    if (1 == charAnno.props.value("wordart", 0)) props.append("wordart");
-    if (1 == charAnno.props.value("handwritten", 0)) props.append("handwritten");
-    std::sort(props.begin(), props.end());
-    QJsonArray jprops;
-    for (QString const &s: props)
-        jprops.append(s);
-    res["attributes"] = jprops;
-    return res;
+    json.beginObject();
+    json.key("adjusted_bbox");
+    writeRect(json, Quad(charAnno.box).adjustedBoundingRect());
+    // 按属性名排序
+    json.key("attributes");
+    json.beginArray();
+    if (1 == charAnno.props.value(CharacterProps::BGCOMPLEX)) json.value(QString("bgcomplex"));
+    if (1 == charAnno.props.value(CharacterProps::RAISED)) json.value(QString("distorted"));
+    if (1 == charAnno.props.value(CharacterProps::HANDWRITTEN)) json.value(QString("handwritten"));
+    if (1 == charAnno.props.value(CharacterProps::COVERED)) json.value(QString("occluded"));
+    if (1 == charAnno.props.value(CharacterProps::PERSPECTIVE)) json.value(QString("raised"));
+    if (1 == charAnno.props.value(CharacterProps::WORDART)) json.value(QString("wordart"));
+    json.endArray();
+    json.key("is_chinese");
+    json.value(isChinese(charAnno.text));
+    json.key("polygon");
+    writePoly(json, charAnno.box);
+    json.key("text");
+    json.value(charAnno.text);
+    json.endObject();
+}
+
+enum { DEFAULT_IMAGE_SIZE = 2048 };
+
+// 与看图工具能打开的图片类型相同
+bool findImage(QDir const &dir, QString const &completeBaseName, QFileInfo &imageInfo) {
+    static char const *const suffixes[] = {"jpg", "png", "bmp", "jpeg", "gif"};
+    for (char const *suffix: suffixes) {
+        imageInfo = QFileInfo(dir.filePath(completeBaseName + "." + suffix));
+        if (imageInfo.isFile())
+            return true;
+    }
+    return false;
 }
 
 class CharCounter {
 public:
-    CharCounter() {
+    enum Format {FORMAT_JSON, FORMAT_CBOR};
+
+public:
+    // 结果写入 out；CBOR 格式同时记下每张图片在 out 中的位置，由 writeIndex 写出
+    CharCounter(QIODevice *out, Format format) : out(out), format(format), outputSize(0), numMissingImage(0) {
         top = 0;
         Statistics::printTitle();
     }
@@ -136,75 +140,198 @@ public:
         }
         total.print("", "Total", "");
     }
-    bool operator()(QString filePath) {
-        if (!filePath.endsWith(".stream"))
+private:
+    CharCounter(CharCounter const &);
+    struct Statistics {
+        Statistics(): cnt(0), numBlkChar(0), numCharWithProps(0), numCharWithoutProps(0), numStar(0), numMask(0) { }
+        int cnt;
+        int numBlkChar; // 不包含 mask
+        int numCharWithProps;
+        int numCharWithoutProps;
+        int numStar;
+        int numMask;
+        Statistics operator +(Statistics const &o) {
+            Statistics r;
+            r.cnt = cnt + o.cnt;
+            r.numBlkChar = numBlkChar + o.numBlkChar;
+            r.numCharWithProps = numCharWithProps + o.numCharWithProps;
+            r.numCharWithoutProps = numCharWithoutProps + o.numCharWithoutProps;
+            r.numStar = numStar + o.numStar;
+            r.numMask = numMask + o.numMask;
+            return r;
+        }
+        static void printTitle() {
+            cerr << QString(QObject::tr("%1 %2 %3 %4 %5 %6 %7 %8  %9")).
+                    arg("#", 5).
+                    arg("name", 7).
+                    arg("#file", 7).
+                    arg("#blk", 7).
+                    arg("#charP", 7).
+                    arg("#charNoP", 7).
+                    arg("#star", 7).
+                    arg("#mask", 7).
+                    arg("filename") << endl;
+        }
+        void print(QString id, QString name, QString folder) const {
+            cerr << QString("%1 %2 %3 %4 %5 %6 %7 %8  %9").
+                    arg(id, 5).
+                    arg(name, 7).
+                    arg(cnt, 7).
+                    arg(numBlkChar, 7).
+                    arg(numCharWithProps, 7).
+                    arg(numCharWithoutProps, 7).
+                    arg(numStar, 7).
+                    arg(numMask, 7).
+                    arg(folder) << endl;
+        }
+    };
+
+public:
+    // 一个文件转换的结果，在工作线程中算出
+    struct Converted {
+        Converted() : ok(false), skipped(false), imageFound(false) {}
+        bool ok;
+        bool skipped;
+        QStringList messages;       // 依次输出到 stderr 的提示和错误
+        std::exception_ptr failure; // writeCharacter 抛出的异常，回到主线程再抛出
+        QByteArray record;          // 这张图片的 JSON 或 CBOR
+        Statistics stat;
+        QStringList texts;
+        bool imageFound;
+        QString probedPath;         // 新读取了尺寸的图片，结束后加入缓存
+        ImageSizeCache::Entry probed;
+    };
+
+    // 图片所在的目录（为空时与 .stream 在同一目录）和尺寸缓存
+    struct ImageSource {
+        QString folder;
+        ImageSizeCache const *cache;
+    };
+
+    static Converted convert(QString const &filePath, Format format, ImageSource const &images) {
+        Converted res;
+        try {
+            if (format == FORMAT_CBOR)
+                res.ok = convertFile<CborWriter>(filePath, images, res);
+            else
+                res.ok = convertFile<JsonWriter>(filePath, images, res);
+        } catch (...) {
+            res.failure = std::current_exception();
+        }
+        return res;
+    }
+
+    // 在主线程中按文件顺序输出和汇总
+    bool operator()(QString const &filePath, Converted const &res) {
+        if (res.skipped)
+            return true;
+        foreach (QString const &message, res.messages)
+            cerr << message << endl;
+        if (res.failure)
+            std::rethrow_exception(res.failure);
+        if (!res.ok)
+            return false;
+        if (!res.probedPath.isEmpty())
+            probed.append(qMakePair(res.probedPath, res.probed));
+        if (!res.imageFound)
+            numMissingImage++;
+        QByteArray record(res.record);
+        if (format == FORMAT_CBOR)
+            index.append(qMakePair(QFileInfo(filePath).baseName(), qMakePair(outputSize, (qint64)record.size())));
+        else
+            record += '\n';
+        if (out->write(record) != record.size()) {
+            cerr << "write failed" << endl;
+            return false;
+        }
+        outputSize += record.size();
+        foreach (QString const &text, res.texts) {
+            if (bucket.find(text) == bucket.end())
+                bucket[text] = 0;
+            bucket[text]++;
+        }
+        QFileInfo fileInfo(filePath);
+        QString dirName = fileInfo.dir().path();
+        res.stat.print(QString("%1").arg(++top), fileInfo.completeBaseName(), dirName);
+        folderStat[dirName] = folderStat[dirName] + res.stat;
+        return true;
+    }
+
+private:
+    template <typename Writer>
+    static bool convertFile(QString const &filePath, ImageSource const &images, Converted &res) {
+        if (!filePath.endsWith(".stream")) {
+            res.skipped = true;
             return true;
+        }
         QFile file(filePath);
-        if (!file.open(QIODevice::ReadOnly)) {
-            cerr << "open failed: " << file.fileName() << endl;
+        if (!file.exists()) {
+            res.messages.append("open failed: " + file.fileName());
             return false;
         }
-        QDataStream st(&file);
         ImageAnnotation anno;
-        st >> anno;
-        file.close();
-        if (st.status() != QDataStream::Ok) {
-            cerr << "stream is bad: " << file.fileName() << endl;
+        if (!AnnotationFile::readAnnotation(filePath, anno)) {
+            res.messages.append("stream is bad: " + file.fileName());
             return false;
         }
-        QJsonArray imageBlocks, imageMasks;
-        Statistics stat;
+        // annotations 直接写入 res.record；ignore 先写到本线程复用的缓冲区，最后按键的顺序拼上
+        static thread_local QByteArray masks;
+        masks.reserve(qMax(masks.capacity(), 4096)); // 预留过的缓冲区清空时不释放
+        masks.resize(0);
+        Writer json(res.record);
+        Writer ignore(masks);
+        json.beginObject();
+        json.key("annotations");
+        json.beginArray();
+        ignore.beginArray();
+        Statistics &stat(res.stat);
         stat.cnt = 1;
         foreach (BlockAnnotation const &block, anno.blocks) {
             bool hasMask = false;
             bool hasNotMask = false;
-            QJsonArray blockArray;
+            bool blockStarted = false;
             foreach (CharacterAnnotation const &_ch, block.characters) {
                 CharacterAnnotation ch(_ch);
-                if (1 == ch.props.value("mask", 0)) {
-                    QJsonObject mask;
-                    mask["polygon"] = poly2json(ch.box);
-                    mask["bbox"] = poly2bbox(ch.box);
-                    imageMasks.append(mask);
+                if (1 == ch.props.value(CharacterProps::MASK)) {
+                    writeMask(ignore, ch.box);
                     hasMask = true;
                     continue;
                 }
                 if (ch.text.isEmpty())
                     continue;
                 if (ch.box.size() != 4) {
-                    cerr << "polygon size != 4: " << file.fileName() << endl;
+                    res.messages.append("polygon size != 4: " + file.fileName());
                     return false;
                 }
                 hasNotMask = true;
                 QString &text = ch.text;
                 if (text.length() != 1) {
                     if (text != "𫔭") {
-                        cerr << "Warning: text length != 1 @ " << file.fileName() << endl;
-                        cerr << text.length() << " " << text << endl;
+                        res.messages.append("Warning: text length != 1 @ " + file.fileName());
+                        res.messages.append(QString::number(text.length()) + " " + text);
                     }
                     text = "*";
                 }
                 if (text == "*") {
-                    QJsonObject mask;
-                    mask["polygon"] = poly2json(ch.box);
-                    mask["bbox"] = poly2bbox(ch.box);
-                    imageMasks.append(mask);
+                    writeMask(ignore, ch.box);
                     stat.numStar++;
                 } else {
-                    blockArray.append(character2json(ch));
-                    if (0 == ch.props.value("pass", 0))
+                    if (!blockStarted) {
+                        json.beginArray();
+                        blockStarted = true;
+                    }
+                    writeCharacter(json, ch);
+                    if (0 == ch.props.value(CharacterProps::PASS))
                         stat.numCharWithoutProps++;
                     else
                         stat.numCharWithProps++;
-                    if (bucket.find(text) == bucket.end())
-                        bucket[text] = 0;
-                    bucket[text]++;
+                    res.texts.append(text);
                 }
             }
-            if (!blockArray.isEmpty())
-                imageBlocks.append(blockArray);
+            if (blockStarted)
+                json.endArray();
             if (hasMask && hasNotMask) {
-                cerr << "impossible block has mask and text: " << file.fileName() << endl;
+                res.messages.append("impossible block has mask and text: " + file.fileName());
                 return false;
             }
             if (hasMask)
@@ -212,68 +339,71 @@ public:
             else if (hasNotMask)
                 stat.numBlkChar++;
         }
+        json.endArray();
+        ignore.endArray();
         QFileInfo fileInfo(file.fileName());
-        QJsonObject json;
-        json["image_id"] = fileInfo.baseName();
-        json["file_name"] = fileInfo.baseName() + ".jpg";
-        json["width"] = 2048;
-        json["height"] = 2048;
-        json["annotations"] = imageBlocks;
-        json["ignore"] = imageMasks;
-        QJsonDocument doc;
-        doc.setObject(json);
-        cout << doc.toJson(QJsonDocument::Compact) << endl;
-
-        QString dirName = fileInfo.dir().path();
-        stat.print(QString("%1").arg(++top), fileInfo.completeBaseName(), dirName);
-        folderStat[dirName] = folderStat[dirName] + stat;
+        // 找不到图片或读不出尺寸时沿用以前的假设
+        QString imageName = fileInfo.baseName() + ".jpg";
+        QSize imageSize(DEFAULT_IMAGE_SIZE, DEFAULT_IMAGE_SIZE);
+        QFileInfo imageInfo;
+        QDir imageDir(images.folder.isEmpty() ? fileInfo.dir() : QDir(images.folder));
+        if (findImage(imageDir, fileInfo.completeBaseName(), imageInfo)) {
+            if (images.cache && images.cache->lookup(imageInfo, imageSize)) {
+                res.imageFound = true;
+            } else if (ImageSizeCache::probe(imageInfo, res.probed)) {
+                res.imageFound = true;
+                res.probedPath = imageInfo.absoluteFilePath();
+                imageSize = res.probed.value;
+            }
+            if (res.imageFound)
+                imageName = imageInfo.fileName();
+        }
+        json.key("file_name");
+        json.value(imageName);
+        json.key("height");
+        json.value(imageSize.height());
+        json.key("ignore");
+        json.raw(masks);
+        json.key("image_id");
+        json.value(fileInfo.baseName());
+        json.key("width");
+        json.value(imageSize.width());
+        json.endObject();
         return true;
     }
-private:
-    CharCounter(CharCounter const &);
-    struct Statistics {
-        Statistics(): cnt(0), numBlkChar(0), numCharWithProps(0), numCharWithoutProps(0), numStar(0), numMask(0) { }
-        int cnt;
-        int numBlkChar; // 不包含 mask
-        int numCharWithProps;
-        int numCharWithoutProps;
-        int numStar;
-        int numMask;
-        Statistics operator +(Statistics const &o) {
-            Statistics r;
-            r.cnt = cnt + o.cnt;
-            r.numBlkChar = numBlkChar + o.numBlkChar;
-            r.numCharWithProps = numCharWithProps + o.numCharWithProps;
-            r.numCharWithoutProps = numCharWithoutProps + o.numCharWithoutProps;
-            r.numStar = numStar + o.numStar;
-            r.numMask = numMask + o.numMask;
-            return r;
-        }
-        static void printTitle() {
-            cerr << QString(QObject::tr("%1 %2 %3 %4 %5 %6 %7 %8  %9")).
-                    arg("#", 5).
-                    arg("name", 7).
-                    arg("#file", 7).
-                    arg("#blk", 7).
-                    arg("#charP", 7).
-                    arg("#charNoP", 7).
-                    arg("#star", 7).
-                    arg("#mask", 7).
-                    arg("filename") << endl;
-        }
-        void print(QString id, QString name, QString folder) const {
-            cerr << QString("%1 %2 %3 %4 %5 %6 %7 %8  %9").
-                    arg(id, 5).
-                    arg(name, 7).
-                    arg(cnt, 7).
-                    arg(numBlkChar, 7).
-                    arg(numCharWithProps, 7).
-                    arg(numCharWithoutProps, 7).
-                    arg(numStar, 7).
-                    arg(numMask, 7).
-                    arg(folder) << endl;
+
+public:
+    // 处理完之后把新读取的图片尺寸加入缓存
+    void addProbedTo(ImageSizeCache &cache) const {
+        for (int i = 0; i < probed.size(); i++)
+            cache.insert(probed[i].first, probed[i].second);
+    }
+
+    int missingImages() const {
+        return numMissingImage;
+    }
+
+    // 索引是 CBOR 数组，每项为 [image_id, 偏移, 长度]，按输出顺序排列
+    bool writeIndex(QIODevice *device) const {
+        QByteArray data;
+        CborWriter cbor(data);
+        cbor.beginArray(index.size());
+        for (int i = 0; i < index.size(); i++) {
+            cbor.beginArray(3);
+            cbor.value(index[i].first);
+            cbor.value(index[i].second.first);
+            cbor.value(index[i].second.second);
         }
-    };
+        return device->write(data) == data.size();
+    }
+
+private:
+    QIODevice *out;
+    Format format;
+    qint64 outputSize;
+    QVector<QPair<QString, QPair<qint64, qint64> > > index;
+    QVector<QPair<QString, ImageSizeCache::Entry> > probed;
+    int numMissingImage;
     int top;
     QMap<QString, int> bucket;
     QMap<QString, Statistics> folderStat;
@@ -282,9 +412,19 @@ private:
 int main(int argc, char *argv[]) {
     QCoreApplication app(argc, argv);
     app.setApplicationVersion("v0.0.1");
-    cout.setCodec("utf8");
 
     QCommandLineParser parser;
+    QCommandLineOption formatOption("format", "Output format: json (one line per image) or cbor.", "format", "json");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Write to <file> instead of stdout. For cbor, the index is written to <file>.index.", "file");
+    QCommandLineOption imagesOption("images", "Folder of the images. By default images are next to the .stream files.", "folder");
+    QCommandLineOption sizeCacheOption("size-cache", "Cache of image sizes. Default: .imagesize.cache in the annotation folder.", "file");
+    QCommandLineOption noSizeCacheOption("no-size-cache", "Do not read or write the image size cache.");
+    parser.addOption(formatOption);
+    parser.addOption(outputOption);
+    parser.addOption(imagesOption);
+    parser.addOption(sizeCacheOption);
+    parser.addOption(noSizeCacheOption);
     parser.process(app);
     const QStringList args = parser.positionalArguments();
     if (args.size() < 1) {
@@ -292,14 +432,75 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     QDir rootDir(args[0]);
+    CharCounter::Format format;
+    if (parser.value(formatOption) == "json") {
+        format = CharCounter::FORMAT_JSON;
+    } else if (parser.value(formatOption) == "cbor") {
+        format = CharCounter::FORMAT_CBOR;
+    } else {
+        cerr << "unknown format: " << parser.value(formatOption) << endl;
+        return 1;
+    }
+    if (format == CharCounter::FORMAT_CBOR && !parser.isSet(outputOption)) {
+        cerr << "missing parameter: --output is required for cbor" << endl;
+        return 1;
+    }
+    QFile outFile;
+    bool opened;
+    if (parser.isSet(outputOption)) {
+        outFile.setFileName(parser.value(outputOption));
+        opened = outFile.open(QIODevice::WriteOnly);
+    } else {
+        opened = outFile.open(stdout, QIODevice::WriteOnly);
+    }
+    if (!opened) {
+        cerr << "open failed: " << outFile.fileName() << endl;
+        return 1;
+    }
+
+    ImageSizeCache sizeCache;
+    QString sizeCacheFile;
+    if (!parser.isSet(noSizeCacheOption)) {
+        sizeCacheFile = parser.isSet(sizeCacheOption) ? parser.value(sizeCacheOption) : rootDir.filePath(".imagesize.cache");
+        sizeCache.load(sizeCacheFile);
+    }
+    CharCounter::ImageSource images;
+    images.folder = parser.value(imagesOption);
+    images.cache = sizeCacheFile.isEmpty() ? nullptr : &sizeCache;
 
-    CharCounter charCounter;
+    CharCounter charCounter(&outFile, format);
     QStringList nameFilters;
     nameFilters << "*.stream";
-    std::function<bool(QString)> cb([&](QString filePath) {
-        return charCounter(filePath);
+    // 在工作线程中读取文件、生成 JSON 或 CBOR，按文件顺序输出，与串行处理的结果相同
+    DatasetWalker walker;
+    QStringList files;
+    bool listed = walker.listFiles(rootDir, nameFilters, files);
+    std::function<CharCounter::Converted(QString const &)> convert([format, images](QString const &filePath) {
+        return CharCounter::convert(filePath, format, images);
     });
-    if (!eachFile(rootDir, cb, nameFilters)) {
+    std::function<bool(QString const &, CharCounter::Converted const &)> output(
+                [&](QString const &filePath, CharCounter::Converted const &res) {
+        return charCounter(filePath, res);
+    });
+    bool ok = walker.mapReduce(files, convert, output);
+    if (ok && !listed) {
+        cerr << walker.errorString() << endl;
+        ok = false;
+    }
+    if (charCounter.missingImages() > 0)
+        cerr << "Warning: " << charCounter.missingImages() << " images not found, assumed "
+             << DEFAULT_IMAGE_SIZE << "x" << DEFAULT_IMAGE_SIZE << endl;
+    charCounter.addProbedTo(sizeCache);
+    if (!sizeCacheFile.isEmpty() && sizeCache.isModified() && !sizeCache.save(sizeCacheFile))
+        cerr << "Warning: cannot write " << sizeCacheFile << endl;
+    if (ok && format == CharCounter::FORMAT_CBOR) {
+        QFile indexFile(outFile.fileName() + ".index");
+        if (!indexFile.open(QIODevice::WriteOnly) || !charCounter.writeIndex(&indexFile)) {
+            cerr << "write failed: " << indexFile.fileName() << endl;
+            ok = false;
+        }
+    }
+    if (!ok) {
         cerr << "error occurred" << endl;
         return 1;
     }
@@ -0,0 +1,179 @@
+#include <QThread>
+#include <QAtomicInt>
+#include <QVector>
+#include <QScopedArrayPointer>
+#include <QPair>
+#include "datasetwalker.h"
+
+/// Node
+
+// 一个目录列出的内容，按名字排序；子目录的 second 非空
+struct DatasetWalker::Node {
+    Node(QString const &path) : path(path), exists(true) {}
+    ~Node() {
+        for (int i = 0; i < items.size(); i++)
+            delete items[i].second;
+    }
+
+    QString path;
+    bool exists;
+    QVector<QPair<QString, Node *> > items;
+};
+
+/// Lister
+
+// 每个线程有自己的目录队列，从队尾取；自己的队列空了就从别的线程的队首偷
+class DatasetWalker::Lister {
+public:
+    Lister(int threads, QStringList const &nameFilters)
+        : nameFilters(nameFilters), queues(new Queue[threads]), queueCount(threads), pending(0) {
+    }
+
+    void run(Node *root) {
+        pending.storeRelease(1);
+        queues[0].nodes.append(root);
+        QThreadPool pool;
+        pool.setMaxThreadCount(queueCount);
+        for (int t = 0; t < queueCount; t++)
+            pool.start(new Runner([this, t]() { work(t); }));
+        pool.waitForDone();
+    }
+
+private:
+    struct Queue {
+        QMutex mutex;
+        QList<Node *> nodes;
+    };
+
+    void work(int self) {
+        forever {
+            Node *node = take(self);
+            if (!node) {
+                // 在 idleMutex 中再取一次，list 放入子目录后也要拿到 idleMutex 才通知，不会错过
+                QMutexLocker locker(&idleMutex);
+                while (pending.loadAcquire() > 0 && !(node = take(self)))
+                    available.wait(&idleMutex);
+                if (!node)
+                    return;
+            }
+            list(node, self);
+            if (!pending.deref()) {
+                QMutexLocker locker(&idleMutex);
+                available.wakeAll();
+            }
+        }
+    }
+
+    Node *take(int self) {
+        {
+            QMutexLocker locker(&queues[self].mutex);
+            if (!queues[self].nodes.isEmpty())
+                return queues[self].nodes.takeLast();
+        }
+        for (int i = 1; i < queueCount; i++) {
+            Queue &victim(queues[(self + i) % queueCount]);
+            QMutexLocker locker(&victim.mutex);
+            if (!victim.nodes.isEmpty())
+                return victim.nodes.takeFirst();
+        }
+        return nullptr;
+    }
+
+    void list(Node *node, int self) {
+        QDir dir(node->path);
+        if (!dir.exists()) {
+            node->exists = false;
+            return;
+        }
+        QList<Node *> children;
+        foreach (QFileInfo const &fileInfo, DatasetWalker::entries(dir, nameFilters)) {
+            if (fileInfo.isFile()) {
+                node->items.append(qMakePair(fileInfo.filePath(), (Node *)nullptr));
+            } else {
+                Node *child = new Node(fileInfo.filePath());
+                node->items.append(qMakePair(QString(), child));
+                children.append(child);
+            }
+        }
+        if (children.isEmpty())
+            return;
+        pending.fetchAndAddOrdered(children.size());
+        {
+            // 倒序放入，自己先处理排在前面的子目录
+            QMutexLocker locker(&queues[self].mutex);
+            for (int i = children.size() - 1; i >= 0; i--)
+                queues[self].nodes.append(children[i]);
+        }
+        QMutexLocker locker(&idleMutex);
+        available.wakeAll();
+    }
+
+private:
+    QStringList nameFilters;
+    QScopedArrayPointer<Queue> queues;
+    int queueCount;
+    QAtomicInt pending; // 已发现但还没列完的目录数
+    QMutex idleMutex;
+    QWaitCondition available; // 有新的目录可取，或全部列完
+};
+
+/// DatasetWalker
+
+DatasetWalker::DatasetWalker(int threadCount)
+    : threads(threadCount > 0 ? threadCount : qMax(QThread::idealThreadCount(), 1)) {
+}
+
+int DatasetWalker::threadCount() const {
+    return threads;
+}
+
+QString DatasetWalker::errorString() const {
+    return error;
+}
+
+bool DatasetWalker::forEachFile(QDir dir, QStringList const &nameFilters,
+                                std::function<bool(QString const &)> const &cb, QString *errorMessage) {
+    if (!dir.exists()) {
+        if (errorMessage)
+            *errorMessage = QString("directory not exists: %1").arg(dir.path());
+        return false;
+    }
+    foreach (QFileInfo const &fileInfo, entries(dir, nameFilters)) {
+        if (fileInfo.isFile()) {
+            if (!cb(fileInfo.filePath()))
+                return false;
+        } else {
+            if (!forEachFile(QDir(fileInfo.filePath()), nameFilters, cb, errorMessage))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool DatasetWalker::listFiles(QDir const &root, QStringList const &nameFilters, QStringList &files) {
+    error.clear();
+    files.clear();
+    Node tree(root.path());
+    Lister(threads, nameFilters).run(&tree);
+    return flatten(&tree, files);
+}
+
+QFileInfoList DatasetWalker::entries(QDir dir, QStringList const &nameFilters) {
+    dir.setFilter(QDir::Dirs | QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
+    dir.setNameFilters(nameFilters);
+    return dir.entryInfoList();
+}
+
+bool DatasetWalker::flatten(Node const *node, QStringList &files) {
+    if (!node->exists) {
+        error = QString("directory not exists: %1").arg(node->path);
+        return false;
+    }
+    for (int i = 0; i < node->items.size(); i++) {
+        if (!node->items[i].second)
+            files.append(node->items[i].first);
+        else if (!flatten(node->items[i].second, files))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef DATASETWALKER_H
+#define DATASETWALKER_H
+
+#include <QDir>
+#include <QString>
+#include <QStringList>
+#include <QFileInfoList>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QRunnable>
+#include <functional>
+
+// 批处理工具共用的数据集遍历。
+// listFiles 用多个线程列目录，空闲的线程从其他线程的队列中取目录（工作窃取），
+// 得到的文件顺序与串行递归相同；mapReduce 在有界的线程池中处理文件，reduce 总在调用线程执行
+class DatasetWalker {
+public:
+    enum Order {
+        Ordered,  // 按文件顺序 reduce，输出与串行处理逐字节相同
+        Unordered // 先处理完的先 reduce
+    };
+    enum { IN_FLIGHT_PER_THREAD = 4 }; // 每个线程最多领先 reduce 的文件数，限制重排缓冲的大小
+
+public:
+    explicit DatasetWalker(int threadCount = 0); // 0 表示 CPU 核数
+
+    int threadCount() const;
+    QString errorString() const;
+
+    // 串行遍历，与各工具原先的 eachFile 相同：目录和文件按名字混合排序，深度优先
+    static bool forEachFile(QDir dir, QStringList const &nameFilters,
+                            std::function<bool(QString const &)> const &cb, QString *errorMessage = nullptr);
+    // 列出 root 下所有匹配的文件，顺序与 forEachFile 相同；
+    // 遇到不存在的目录时返回 false，files 中是在它之前的文件
+    bool listFiles(QDir const &root, QStringList const &nameFilters, QStringList &files);
+    // map 在工作线程中执行，reduce 在调用线程中执行；reduce 返回 false 时停止，不再处理剩下的文件
+    template <typename T>
+    bool mapReduce(QStringList const &files, std::function<T(QString const &)> const &map,
+                   std::function<bool(QString const &, T const &)> const &reduce, Order order = Ordered);
+
+private:
+    struct Node;
+    class Lister;
+
+    class Runner : public QRunnable {
+    public:
+        Runner(std::function<void()> const &fn) : fn(fn) {}
+        void run() { fn(); }
+
+    private:
+        std::function<void()> fn;
+    };
+
+    static QFileInfoList entries(QDir dir, QStringList const &nameFilters);
+    bool flatten(Node const *node, QStringList &files);
+
+private:
+    int threads;
+    QString error;
+};
+
+template <typename T>
+bool DatasetWalker::mapReduce(QStringList const &files, std::function<T(QString const &)> const &map,
+                              std::function<bool(QString const &, T const &)> const &reduce, Order order) {
+    int total = files.size();
+    int window = threads * IN_FLIGHT_PER_THREAD;
+    QMutex mutex;
+    QWaitCondition produced, consumed;
+    QMap<int, T> done; // 已处理、尚未 reduce 的结果
+    int next = 0;      // 下一个要处理的文件
+    int reduced = 0;
+    bool stopped = false;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for (int t = 0; t < threads; t++) {
+        pool.start(new Runner([&]() {
+            QMutexLocker locker(&mutex);
+            forever {
+                while (!stopped && next < total && next >= reduced + window)
+                    consumed.wait(&mutex);
+                if (stopped || next >= total)
+                    return;
+                int i = next++;
+                locker.unlock();
+                T result = map(files[i]);
+                locker.relock();
+                done.insert(i, result);
+                produced.wakeAll();
+            }
+        }));
+    }
+
+    bool ok = true;
+    QMutexLocker locker(&mutex);
+    while (reduced < total) {
+        while (done.isEmpty() || (order == Ordered && done.firstKey() != reduced))
+            produced.wait(&mutex);
+        int i = done.firstKey();
+        T result = done.take(i);
+        locker.unlock();
+        ok = reduce(files[i], result);
+        locker.relock();
+        reduced++;
+        consumed.wakeAll();
+        if (!ok) {
+            stopped = true;
+            break;
+        }
+    }
+    locker.unlock();
+    pool.waitForDone();
+    return ok;
+}
+
+#endif // DATASETWALKER_H
@@ -0,0 +1,11 @@
+# 链接 datasetwalker 静态库。在 tools.pro 中它先于各工具构建，输出目录与工具并列
+win32:CONFIG(release, debug|release): DATASETWALKER_DIR = $$OUT_PWD/../datasetwalker/release
+else:win32:CONFIG(debug, debug|release): DATASETWALKER_DIR = $$OUT_PWD/../datasetwalker/debug
+else: DATASETWALKER_DIR = $$OUT_PWD/../datasetwalker
+
+LIBS += -L$$DATASETWALKER_DIR -ldatasetwalker
+DEPENDPATH += $$PWD
+
+win32-g++: PRE_TARGETDEPS += $$DATASETWALKER_DIR/libdatasetwalker.a
+else:win32:!win32-g++: PRE_TARGETDEPS += $$DATASETWALKER_DIR/datasetwalker.lib
+else: PRE_TARGETDEPS += $$DATASETWALKER_DIR/libdatasetwalker.a
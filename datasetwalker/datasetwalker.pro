@@ -0,0 +1,13 @@
+QT += core
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = datasetwalker
+TEMPLATE = lib
+CONFIG += staticlib
+
+SOURCES += datasetwalker.cpp
+
+HEADERS += datasetwalker.h \
+    filecache.h
@@ -0,0 +1,121 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QSaveFile>
+
+// 批处理工具共用的逐文件结果缓存，按绝对路径保存，文件的修改时间或大小变了就作废。
+// T 需要能用 QDataStream 读写；magic 区分不同的缓存，T 的格式变化时增加 version
+template <typename T>
+class FileCache {
+public:
+    struct Entry {
+        Entry() : lastModified(0), fileSize(-1) {}
+
+        qint64 lastModified; // 毫秒
+        qint64 fileSize;
+        T value;
+    };
+
+public:
+    FileCache(quint32 magic, quint32 version) : magic(magic), version(version), modified(false) {}
+
+    // 文件不存在或格式不对时当作空缓存
+    void load(QString const &fileName);
+    // QSaveFile 写完才替换原文件，中途失败不会破坏原有的缓存
+    bool save(QString const &fileName) const;
+    bool isModified() const { return modified; }
+    int size() const { return entries.size(); }
+    void clear();
+
+    // 多个线程可以同时查询，查询期间不能修改
+    bool lookup(QFileInfo const &fileInfo, T &value) const;
+    void insert(QString const &path, Entry const &entry);
+    // 文件当前的修改时间和大小
+    static Entry entryOf(QFileInfo const &fileInfo, T const &value);
+
+private:
+    quint32 magic;
+    quint32 version;
+    QHash<QString, Entry> entries;
+    bool modified;
+};
+
+template <typename T>
+void FileCache<T>::load(QString const &fileName) {
+    entries.clear();
+    modified = false;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_2);
+    quint32 fileMagic, fileVersion, count;
+    stream >> fileMagic >> fileVersion >> count;
+    if (stream.status() != QDataStream::Ok || fileMagic != magic || fileVersion != version)
+        return;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QString path;
+        Entry entry;
+        stream >> path >> entry.lastModified >> entry.fileSize >> entry.value;
+        if (stream.status() == QDataStream::Ok)
+            entries.insert(path, entry);
+    }
+}
+
+template <typename T>
+bool FileCache<T>::save(QString const &fileName) const {
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << magic << version << (quint32)entries.size();
+    for (typename QHash<QString, Entry>::const_iterator it = entries.constBegin(); it != entries.constEnd(); ++it)
+        stream << it.key() << it.value().lastModified << it.value().fileSize << it.value().value;
+    if (stream.status() != QDataStream::Ok) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+template <typename T>
+void FileCache<T>::clear() {
+    if (!entries.isEmpty())
+        modified = true;
+    entries.clear();
+}
+
+template <typename T>
+bool FileCache<T>::lookup(QFileInfo const &fileInfo, T &value) const {
+    typename QHash<QString, Entry>::const_iterator it = entries.constFind(fileInfo.absoluteFilePath());
+    if (it == entries.constEnd())
+        return false;
+    if (it.value().lastModified != fileInfo.lastModified().toMSecsSinceEpoch() || it.value().fileSize != fileInfo.size())
+        return false;
+    value = it.value().value;
+    return true;
+}
+
+template <typename T>
+void FileCache<T>::insert(QString const &path, Entry const &entry) {
+    entries.insert(path, entry);
+    modified = true;
+}
+
+template <typename T>
+typename FileCache<T>::Entry FileCache<T>::entryOf(QFileInfo const &fileInfo, T const &value) {
+    Entry entry;
+    entry.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+    entry.fileSize = fileInfo.size();
+    entry.value = value;
+    return entry;
+}
+
+#endif // FILECACHE_H
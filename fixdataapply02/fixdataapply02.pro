@@ -13,3 +13,5 @@ SOURCES += main.cpp \
 
 HEADERS += \
     ../imageviewer/imageannotation.h
+
+include(../datasetwalker/datasetwalker.pri)
@@ -8,32 +8,11 @@
 #include <QDebug>
 #include <functional>
 #include "../imageviewer/imageannotation.h"
+#include "../datasetwalker/datasetwalker.h"
 
 static QTextStream cin(stdin);
 static QTextStream cout(stdout);
 
-bool eachFile(QDir dir, std::function<bool(QString)> const &cb, QStringList const &nameFilters) {
-    if (!dir.exists()) {
-        cout << "directory not exists: " << dir.path() << endl;
-        return false;
-    }
-    dir.setFilter(QDir::Dirs | QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
-    dir.setNameFilters(nameFilters);
-    QFileInfoList list = dir.entryInfoList();
-    foreach (QFileInfo fileInfo, list) {
-        if (fileInfo.fileName() == "." || fileInfo.fileName() == "..")
-            continue;
-        if (fileInfo.isFile()) {
-            if (!cb(fileInfo.filePath()))
-                return false;
-        } else {
-            if (!eachFile(QDir(fileInfo.filePath()), cb, nameFilters))
-                return false;
-        }
-    }
-    return true;
-}
-
 class CharCounter {
 public:
     CharCounter() {
@@ -213,10 +192,13 @@ int main(int argc, char *argv[]) {
     CharCounter charCounter;
     QStringList nameFilters;
     nameFilters << "*.correction";
-    std::function<bool(QString)> cb([&](QString filePath) {
+    QString errorMessage;
+    std::function<bool(QString const &)> cb([&](QString const &filePath) {
         return charCounter(filePath);
     });
-    if (!eachFile(rootDir, cb, nameFilters)) {
+    if (!DatasetWalker::forEachFile(rootDir, nameFilters, cb, &errorMessage)) {
+        if (!errorMessage.isEmpty())
+            cout << errorMessage << endl;
         cout << "error occurred" << endl;
         return 1;
     }
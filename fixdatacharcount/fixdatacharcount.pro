@@ -9,3 +9,5 @@ CONFIG -= app_bundle
 TEMPLATE = app
 
 SOURCES += main.cpp
+
+include(../datasetwalker/datasetwalker.pri)
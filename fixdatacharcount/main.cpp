@@ -7,33 +7,14 @@
 #include <QImage>
 #include <QDebug>
 #include <functional>
+#include "../datasetwalker/datasetwalker.h"
 
 static QTextStream cin(stdin);
 static QTextStream cout(stdout);
 
-bool eachFile(QDir dir, std::function<bool(QString)> const &cb, QStringList const &nameFilters) {
-    if (!dir.exists()) {
-        cout << "directory not exists: " << dir.path() << endl;
-        return false;
-    }
-    dir.setFilter(QDir::Dirs | QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
-    dir.setNameFilters(nameFilters);
-    QFileInfoList list = dir.entryInfoList();
-    foreach (QFileInfo fileInfo, list) {
-        if (fileInfo.fileName() == "." || fileInfo.fileName() == "..")
-            continue;
-        if (fileInfo.isFile()) {
-            if (!cb(fileInfo.filePath()))
-                return false;
-        } else {
-            if (!eachFile(QDir(fileInfo.filePath()), cb, nameFilters))
-                return false;
-        }
-    }
-    return true;
-}
-
 class CharCounter {
+    typedef QPair<QString, QPair<QRectF, QString> > Locator;
+
 public:
     CharCounter() {
         sumNumBlock = sumNumCharacter = idx = 0;
@@ -57,13 +38,25 @@ public:
                     arg(it.key()) << endl;
         }
     }
-    bool operator()(QString filePath) {
-        if (!filePath.endsWith(".correction"))
-            return true;
+    // 一个文件的计数，在工作线程中算出
+    struct Counted {
+        Counted() : skipped(false), numBlock(0), numCharacter(0) {}
+        bool skipped;
+        QString error;
+        int numBlock;
+        int numCharacter;
+    };
+
+    static Counted count(QString const &filePath) {
+        Counted res;
+        if (!filePath.endsWith(".correction")) {
+            res.skipped = true;
+            return res;
+        }
         QFile file(filePath);
         if (!file.open(QIODevice::ReadOnly)) {
-            cout << "open failed: " << file.fileName() << endl;
-            return false;
+            res.error = "open failed: " + file.fileName();
+            return res;
         }
         QByteArray array(file.readAll());
         file.close();
@@ -73,18 +66,17 @@ public:
         QVector<QPair<Locator, QPair<QString, int> > > correction_loaded;
         st >> correction_loaded;
         if (st.status() != QDataStream::Ok) {
-            cout << "stream is bad: " << file.fileName() << endl;
-            return false;
+            res.error = "stream is bad: " + file.fileName();
+            return res;
         }
-        int numBlock = 0;
-        int numCharacter = correction_loaded.size();
+        res.numCharacter = correction_loaded.size();
         QFileInfo fileInfo(file.fileName());
         QString dirName = fileInfo.dir().path();
         QFile doubtFile(QDir(dirName).filePath(fileInfo.completeBaseName() + ".doubt"));
         if (doubtFile.exists()) {
             if (!doubtFile.open(QIODevice::ReadOnly)) {
-                cout << "open failed: " << doubtFile.fileName() << endl;
-                return false;
+                res.error = "open failed: " + doubtFile.fileName();
+                return res;
             }
             QByteArray array(doubtFile.readAll());
             doubtFile.close();
@@ -92,12 +84,27 @@ public:
             QDataStream st(&array, QIODevice::ReadOnly);
             st >> map_loaded;
             if (st.status() != QDataStream::Ok) {
-                cout << "stream is bad: " << file.fileName() << endl;
-                return false;
+                res.error = "stream is bad: " + file.fileName();
+                return res;
             }
             for (auto it = map_loaded.begin(); it != map_loaded.end(); it++)
-                numBlock += it.value().size();
+                res.numBlock += it.value().size();
+        }
+        return res;
+    }
+
+    // 在主线程中按文件顺序输出和汇总
+    bool operator()(QString const &filePath, Counted const &res) {
+        if (res.skipped)
+            return true;
+        if (!res.error.isEmpty()) {
+            cout << res.error << endl;
+            return false;
         }
+        int numBlock = res.numBlock;
+        int numCharacter = res.numCharacter;
+        QFileInfo fileInfo(filePath);
+        QString dirName = fileInfo.dir().path();
         cout << QString("%1 %2 %3 %4  %5").arg(++idx, 5).
                 arg(fileInfo.completeBaseName(), 19).
                 arg(numBlock, 6).
@@ -119,7 +126,6 @@ private:
     int sumNumCharacter;
     int idx;
     QMap<QString, QPair<int, int> > folderCount;
-    typedef QPair<QString, QPair<QRectF, QString> > Locator;
 };
 
 int main(int argc, char *argv[]) {
@@ -138,10 +144,20 @@ int main(int argc, char *argv[]) {
     CharCounter charCounter;
     QStringList nameFilters;
     nameFilters << "*.correction";
-    std::function<bool(QString)> cb([&](QString filePath) {
-        return charCounter(filePath);
+    DatasetWalker walker;
+    QStringList files;
+    bool listed = walker.listFiles(rootDir, nameFilters, files);
+    std::function<CharCounter::Counted(QString const &)> count(&CharCounter::count);
+    std::function<bool(QString const &, CharCounter::Counted const &)> sum(
+                [&](QString const &filePath, CharCounter::Counted const &res) {
+        return charCounter(filePath, res);
     });
-    if (!eachFile(rootDir, cb, nameFilters)) {
+    bool ok = walker.mapReduce(files, count, sum);
+    if (ok && !listed) {
+        cout << walker.errorString() << endl;
+        ok = false;
+    }
+    if (!ok) {
         cout << "error occurred" << endl;
         return 1;
     }
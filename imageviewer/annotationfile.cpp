@@ -0,0 +1,343 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QBuffer>
+#include <QObject>
+#include "annotationfile.h"
+
+/// AnnotationFile
+
+AnnotationFile::Status AnnotationFile::read(QString const &fileName, ImageAnnotation &anno, AnnotationHistory &history) {
+    Journal journal;
+    Status status = readFile(fileName, journal, true);
+    anno = journal.anno;
+    history = journal.history;
+    return status;
+}
+
+AnnotationFile::Status AnnotationFile::readJournal(QString const &fileName, Journal &journal) {
+    return readFile(fileName, journal, true);
+}
+
+bool AnnotationFile::readAnnotation(QString const &fileName, ImageAnnotation &anno) {
+    Journal journal;
+    Status status = readFile(fileName, journal, false);
+    anno = journal.anno;
+    // 与以前只读取 ImageAnnotation 一样，不关心历史记录是否完好
+    return status == Ok || status == CorruptedHistory;
+}
+
+bool AnnotationFile::parseAnnotation(QByteArray const &content, ImageAnnotation &anno) {
+    QBuffer buffer;
+    buffer.setData(content);
+    buffer.open(QIODevice::ReadOnly);
+    Journal journal;
+    Status status = readDevice(buffer, journal, false);
+    anno = journal.anno;
+    return status == Ok || status == CorruptedHistory;
+}
+
+AnnotationFile::Status AnnotationFile::parse(QByteArray const &content, ImageAnnotation &anno, AnnotationHistory &history) {
+    QBuffer buffer;
+    buffer.setData(content);
+    buffer.open(QIODevice::ReadOnly);
+    Journal journal;
+    Status status = readDevice(buffer, journal, true);
+    anno = journal.anno;
+    history = journal.history;
+    return status;
+}
+
+bool AnnotationFile::serialize(ImageAnnotation const &anno, AnnotationHistory const &history, QByteArray &data) {
+    bool ok;
+    QByteArray historyData(history.compressed(&ok));
+    if (!ok)
+        return false;
+    QByteArray annoData;
+    QDataStream st(&annoData, QIODevice::WriteOnly);
+    st << anno;
+    QVector<QPair<SectionType, QByteArray> > contents;
+    contents.append(qMakePair(SECTION_ANNOTATION, annoData));
+    contents.append(qMakePair(SECTION_HISTORY, historyData));
+    data.clear();
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << (quint32)SECTIONED_VERSION;
+    stream << (quint32)contents.size();
+    qint64 offset = 2 * sizeof(quint32) + contents.size() * SECTION_ENTRY_SIZE;
+    for (int i = 0; i < contents.size(); i++) {
+        QByteArray const &section(contents[i].second);
+        stream << (quint32)contents[i].first << offset << (qint64)section.size()
+               << qChecksum(section.constData(), section.size());
+        offset += section.size();
+    }
+    for (int i = 0; i < contents.size(); i++)
+        stream.writeRawData(contents[i].second.constData(), contents[i].second.size());
+    return true;
+}
+
+bool AnnotationFile::write(QString const &fileName, ImageAnnotation const &anno, AnnotationHistory const &history,
+                           QString *errorMessage, Journal *journal) {
+    QByteArray data;
+    if (!serialize(anno, history, data)) {
+        // 不能用只剩一步的历史记录覆盖无法解码的原有历史记录
+        if (errorMessage)
+            *errorMessage = QObject::tr("Cannot decode history of %1.").arg(fileName);
+        return false;
+    }
+    QFile file0(fileName);
+    QFile file1(fileName + ".tmp");
+    if (file1.exists()) {
+        if (errorMessage)
+            *errorMessage = QObject::tr("Already exists %1.").arg(file1.fileName());
+        return false;
+    }
+    if (!file1.open(QIODevice::WriteOnly)) {
+        if (errorMessage)
+            *errorMessage = QObject::tr("Cannot write %1.").arg(file1.fileName());
+        return false;
+    }
+    qint64 size = data.size();
+    bool written = file1.write(data) == size;
+    file1.close();
+    if (!written) {
+        file1.remove();
+        if (errorMessage)
+            *errorMessage = QObject::tr("Cannot write %1.").arg(file1.fileName());
+        return false;
+    }
+    file0.remove();
+    if (!file1.rename(file0.fileName())) {
+        if (errorMessage)
+            *errorMessage = QObject::tr("Cannot rename %1.").arg(file0.fileName());
+        return false;
+    }
+    if (journal) {
+        journal->anno = anno;
+        journal->history = history;
+        journal->size = journal->baseSize = size;
+        journal->records = 0;
+        journal->lastModified = QFileInfo(fileName).lastModified();
+    }
+    return true;
+}
+
+bool AnnotationFile::append(QString const &fileName, Journal &journal, ImageAnnotation const &anno,
+                            AnnotationHistory const &history, QString *errorMessage) {
+    Q_ASSERT(journal.size >= 0);
+    QByteArray data;
+    int records = 0;
+    AnnotationHistory saved(history);
+    if (!history.isSameAs(journal.history)) {
+        AnnotationHistory old(journal.history);
+        old.decode();
+        saved.decode();
+        int keep = saved.commonPrefix(old);
+        if (keep != old.size() || keep != saved.size()) {
+            QByteArray payload;
+            QDataStream st(&payload, QIODevice::WriteOnly);
+            st << (quint32)keep;
+            saved.writeEntries(st, keep);
+            data += record(RECORD_HISTORY, qCompress(payload));
+            records++;
+        }
+    }
+    if (!(anno == journal.anno)) {
+        QByteArray payload;
+        QDataStream st(&payload, QIODevice::WriteOnly);
+        AnnotationHistory::writeDelta(st, journal.anno, anno);
+        data += record(RECORD_STATE, payload);
+        records++;
+    }
+    if (!data.isEmpty()) {
+        QFile file(fileName);
+        bool ok = file.open(QIODevice::ReadWrite);
+        // 去掉上次写到一半的记录
+        if (ok && file.size() != journal.size)
+            ok = file.resize(journal.size);
+        ok = ok && file.seek(journal.size) && file.write(data) == data.size() && file.flush();
+        file.close();
+        if (!ok) {
+            if (errorMessage)
+                *errorMessage = QObject::tr("Cannot write %1.").arg(fileName);
+            return false;
+        }
+        journal.size += data.size();
+        journal.records += records;
+        journal.lastModified = QFileInfo(fileName).lastModified();
+    }
+    journal.anno = anno;
+    journal.history = saved;
+    return true;
+}
+
+bool AnnotationFile::compact(QString const &fileName, QString *errorMessage) {
+    Journal journal;
+    if (readJournal(fileName, journal) != Ok) {
+        if (errorMessage)
+            *errorMessage = QObject::tr("Cannot read %1.").arg(fileName);
+        return false;
+    }
+    if (!journal.history.decode()) {
+        if (errorMessage)
+            *errorMessage = QObject::tr("Cannot decode history of %1.").arg(fileName);
+        return false;
+    }
+    return write(fileName, journal.anno, journal.history, errorMessage);
+}
+
+AnnotationFile::Status AnnotationFile::readFile(QString const &fileName, Journal &journal, bool withHistory) {
+    journal = Journal();
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return NotFound;
+    journal.lastModified = QFileInfo(file).lastModified();
+    return readDevice(file, journal, withHistory);
+}
+
+AnnotationFile::Status AnnotationFile::readDevice(QIODevice &device, Journal &journal, bool withHistory) {
+    QDataStream stream(&device);
+    quint32 version;
+    stream >> version;
+    bool hasVersion = stream.status() == QDataStream::Ok;
+    bool isSectioned = hasVersion && version == (quint32)SECTIONED_VERSION;
+    bool isJournal = isSectioned || (hasVersion && version == (quint32)JOURNAL_VERSION);
+    QByteArray array;
+    bool historyOk = true;
+    if (isSectioned) {
+        // 历史记录损坏时仍要重放之后追加的标注记录，最后再报告
+        Status status = readSections(device, stream, journal, withHistory, array, historyOk);
+        if (status != Ok)
+            return status;
+    } else {
+        if (!isJournal) {
+            // 旧格式直接从 ImageAnnotation 开始
+            device.seek(0);
+            stream.resetStatus();
+        }
+        stream >> journal.anno;
+        if (stream.status() != QDataStream::Ok)
+            return CorruptedAnnotation;
+        if (withHistory) {
+            stream >> array;
+        } else {
+            quint32 length;
+            stream >> length;
+            if (length != 0xffffffff && stream.skipRawData(length) != (int)length)
+                stream.setStatus(QDataStream::ReadPastEnd);
+        }
+        if (stream.status() != QDataStream::Ok)
+            return CorruptedHistory;
+    }
+    journal.baseSize = device.pos();
+    if (isJournal)
+        journal.size = journal.baseSize;
+    QVector<QByteArray> historyRecords;
+    while (isJournal && !stream.atEnd()) {
+        quint8 type;
+        QByteArray payload;
+        quint16 checksum;
+        stream >> type;
+        if (type == RECORD_HISTORY && (!withHistory || !historyOk) && stream.status() == QDataStream::Ok) {
+            // 不需要历史记录或基础的历史记录已损坏时跳过数据，不校验
+            quint32 length;
+            stream >> length;
+            if (length == 0xffffffff || stream.skipRawData(length) != (int)length)
+                break;
+            stream >> checksum;
+            if (stream.status() != QDataStream::Ok)
+                break;
+            journal.records++;
+            journal.size = device.pos();
+            continue;
+        }
+        stream >> payload;
+        stream >> checksum;
+        if (stream.status() != QDataStream::Ok || checksum != qChecksum(payload.constData(), payload.size()))
+            break; // 写到一半的记录
+        if (type == RECORD_STATE) {
+            QDataStream st(payload);
+            ImageAnnotation anno(journal.anno);
+            if (!AnnotationHistory::readDelta(st, anno))
+                break;
+            journal.anno = anno;
+        } else if (type == RECORD_HISTORY) {
+            if (withHistory)
+                historyRecords.append(payload);
+        } else {
+            break;
+        }
+        journal.records++;
+        journal.size = device.pos();
+    }
+    if (!historyOk)
+        return CorruptedHistory;
+    // 历史记录先不解压，由调用者在需要时解码
+    if (withHistory)
+        journal.history.setCompressed(array, journal.anno, historyRecords);
+    return Ok;
+}
+
+AnnotationFile::Status AnnotationFile::readSections(QIODevice &device, QDataStream &stream, Journal &journal,
+                                                   bool withHistory, QByteArray &history, bool &historyOk) {
+    quint32 count;
+    stream >> count;
+    if (stream.status() != QDataStream::Ok || count > MAX_SECTIONS)
+        return CorruptedAnnotation;
+    QVector<Section> sections(count);
+    for (quint32 i = 0; i < count; i++)
+        stream >> sections[i].type >> sections[i].offset >> sections[i].length >> sections[i].checksum;
+    if (stream.status() != QDataStream::Ok)
+        return CorruptedAnnotation;
+    qint64 headerSize = device.pos();
+    qint64 end = headerSize;
+    int annoIndex = -1;
+    int historyIndex = -1;
+    bool truncated = false;
+    for (int i = 0; i < sections.size(); i++) {
+        Section const &section(sections[i]);
+        if (section.offset < headerSize || section.length < 0 || section.offset + section.length > device.size()) {
+            // 写到一半的文件：标注段损坏则无法读取，其余段损坏时先读出标注
+            if (section.type == SECTION_ANNOTATION)
+                return CorruptedAnnotation;
+            truncated = true;
+            continue;
+        }
+        end = qMax(end, section.offset + section.length);
+        if (section.type == SECTION_ANNOTATION)
+            annoIndex = i;
+        else if (section.type == SECTION_HISTORY)
+            historyIndex = i;
+        // 不认识的段留给以后的版本，跳过
+    }
+    QByteArray data;
+    if (annoIndex < 0 || !readSection(device, sections[annoIndex], data))
+        return CorruptedAnnotation;
+    QDataStream st(data);
+    st >> journal.anno;
+    if (st.status() != QDataStream::Ok)
+        return CorruptedAnnotation;
+    if (historyIndex < 0 || (withHistory && !readSection(device, sections[historyIndex], history))) {
+        historyOk = false;
+        history.clear();
+    }
+    // 追加的记录从最后一段之后开始；有段超出文件末尾时文件被截断，不会有追加的记录
+    if (!device.seek(truncated ? device.size() : end))
+        return CorruptedAnnotation;
+    return Ok;
+}
+
+bool AnnotationFile::readSection(QIODevice &device, Section const &section, QByteArray &data) {
+    if (!device.seek(section.offset))
+        return false;
+    data = device.read(section.length);
+    return data.size() == section.length && qChecksum(data.constData(), data.size()) == section.checksum;
+}
+
+QByteArray AnnotationFile::record(RecordType type, QByteArray const &payload) {
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << (quint8)type;
+    stream << payload;
+    stream << qChecksum(payload.constData(), payload.size());
+    return data;
+}
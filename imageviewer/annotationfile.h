@@ -0,0 +1,91 @@
+#ifndef ANNOTATIONFILE_H
+#define ANNOTATIONFILE_H
+
+#include <QString>
+#include <QVector>
+#include <QDateTime>
+#include "imageannotation.h"
+#include "annotationhistory.h"
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+class QDataStream;
+QT_END_NAMESPACE
+
+// .stream 标注文件的读写
+//
+// 旧格式（0x1002）：ImageAnnotation，压缩的历史记录
+// 日志格式（0x1003）：版本号，作为基础的 ImageAnnotation 和压缩的历史记录，之后是追加的记录。
+// 每条记录是 (类型, 数据, 校验和)，保存时只追加变化的部分；写到一半的记录校验失败，读取时忽略
+// 分段格式（0x1004）：版本号，段表，各段内容，之后是与 0x1003 相同的追加记录。
+// 段表每项是 (类型, 偏移, 长度, 校验和)，只需要标注的读者直接跳到标注段，不用读历史记录
+class AnnotationFile {
+public:
+    enum Status {
+        Ok,
+        NotFound,            // 文件不存在或无法打开
+        CorruptedAnnotation, // 标注无法解析
+        CorruptedHistory     // 标注可以解析，但历史记录损坏
+    };
+
+    enum { JOURNAL_VERSION = 0x1003, SECTIONED_VERSION = 0x1004 };
+    enum SectionType {
+        SECTION_ANNOTATION = 1, // 作为基础的 ImageAnnotation
+        SECTION_HISTORY = 2     // 压缩的历史记录，即 AnnotationHistory::compressed()
+    };
+    enum { SECTION_ENTRY_SIZE = 22, MAX_SECTIONS = 64 }; // 段表每项的字节数；段数超过上限视为损坏
+    enum RecordType {
+        RECORD_STATE = 1,    // 标注相对上一状态的增量
+        RECORD_HISTORY = 2   // 保留的历史步数和之后新增的步（压缩）
+    };
+
+    // 文件在磁盘上的内容，追加写入时据此计算增量
+    struct Journal {
+        Journal() : size(-1), baseSize(0), records(0) {}
+
+        ImageAnnotation anno;
+        AnnotationHistory history;
+        qint64 size;        // 有效数据的长度，旧格式为 -1，不能追加
+        qint64 baseSize;    // 开头完整快照的长度
+        int records;        // 追加的记录数
+        QDateTime lastModified;
+    };
+
+public:
+    static Status read(QString const &fileName, ImageAnnotation &anno, AnnotationHistory &history);
+    static Status readJournal(QString const &fileName, Journal &journal);
+    // 只读取标注，不解码历史记录，供统计等工具使用
+    static bool readAnnotation(QString const &fileName, ImageAnnotation &anno);
+    // 同 readAnnotation，从内存中的 .stream 内容读取
+    static bool parseAnnotation(QByteArray const &content, ImageAnnotation &anno);
+    // 同 read，从内存中的 .stream 内容读取，可以是任一种格式
+    static Status parse(QByteArray const &content, ImageAnnotation &anno, AnnotationHistory &history);
+    // 只有基础快照的分段格式，即 write 写入的内容；历史记录无法解码时返回 false
+    static bool serialize(ImageAnnotation const &anno, AnnotationHistory const &history, QByteArray &data);
+    // 整体重写为只有基础快照的日志（即压缩）。先写入 .tmp 再改名，失败时返回 false 并给出错误信息
+    static bool write(QString const &fileName, ImageAnnotation const &anno, AnnotationHistory const &history,
+                      QString *errorMessage = nullptr, Journal *journal = nullptr);
+    // 在 journal 描述的文件末尾追加与其相比变化的部分，成功后更新 journal
+    static bool append(QString const &fileName, Journal &journal, ImageAnnotation const &anno,
+                       AnnotationHistory const &history, QString *errorMessage = nullptr);
+    static bool compact(QString const &fileName, QString *errorMessage = nullptr);
+
+private:
+    struct Section {
+        Section() : type(0), offset(0), length(0), checksum(0) {}
+
+        quint32 type;
+        qint64 offset;
+        qint64 length;
+        quint16 checksum;
+    };
+
+    static Status readFile(QString const &fileName, Journal &journal, bool withHistory);
+    static Status readDevice(QIODevice &device, Journal &journal, bool withHistory);
+    static Status readSections(QIODevice &device, QDataStream &stream, Journal &journal,
+                               bool withHistory, QByteArray &history, bool &historyOk);
+    static bool readSection(QIODevice &device, Section const &section, QByteArray &data);
+    static QByteArray record(RecordType type, QByteArray const &payload);
+};
+
+#endif // ANNOTATIONFILE_H
@@ -0,0 +1,352 @@
+#include <QDataStream>
+#include "annotationhistory.h"
+
+/// AnnotationHistory
+
+AnnotationHistory::AnnotationHistory()
+    : cursor(-1), decoded(true) {
+}
+
+void AnnotationHistory::clear() {
+    entries.clear();
+    cursor = -1;
+    head = ImageAnnotation();
+    decoded = true;
+    packed.clear();
+    appended.clear();
+    merged.clear();
+}
+
+void AnnotationHistory::setCompressed(QByteArray const &data, ImageAnnotation const &fallback,
+                                      QVector<QByteArray> const &journal) {
+    clear();
+    head = fallback;
+    decoded = false;
+    packed = data;
+    appended = journal;
+}
+
+bool AnnotationHistory::isDecoded() const {
+    return decoded;
+}
+
+bool AnnotationHistory::decode() {
+    if (decoded)
+        return true;
+    QByteArray array = qUncompress(packed);
+    QDataStream stream(&array, QIODevice::ReadOnly);
+    AnnotationHistory history;
+    stream >> history;
+    bool ok = stream.status() == QDataStream::Ok;
+    for (int i = 0; ok && i < appended.size(); i++) {
+        QByteArray record = qUncompress(appended[i]);
+        QDataStream st(&record, QIODevice::ReadOnly);
+        quint32 keep;
+        st >> keep;
+        ok = st.status() == QDataStream::Ok && history.readEntries(st, keep);
+    }
+    if (!ok) {
+        ImageAnnotation fallback(head);
+        clear();
+        push(fallback);
+        return false;
+    }
+    history.packed = packed;
+    history.appended = appended;
+    *this = history;
+    return true;
+}
+
+QByteArray AnnotationHistory::compressed(bool *ok) const {
+    if (ok)
+        *ok = true;
+    if (!packed.isEmpty() && appended.isEmpty())
+        return packed;
+    // 改动过的历史记录会清空 packed，缓存随之失效
+    if (!packed.isEmpty() && !merged.isEmpty())
+        return merged;
+    QByteArray res;
+    if (!decoded) {
+        AnnotationHistory history(*this);
+        if (!history.decode()) {
+            if (ok)
+                *ok = false;
+            return history.compressed();
+        }
+        res = history.compressed();
+    } else {
+        QByteArray array;
+        QDataStream stream(&array, QIODevice::WriteOnly);
+        stream << *this;
+        res = qCompress(array);
+    }
+    if (!packed.isEmpty())
+        merged = res;
+    return res;
+}
+
+bool AnnotationHistory::isSameAs(AnnotationHistory const &other) const {
+    return !packed.isEmpty() && packed == other.packed && appended == other.appended;
+}
+
+int AnnotationHistory::commonPrefix(AnnotationHistory const &other) const {
+    Q_ASSERT(decoded && other.decoded);
+    int n = qMin(size(), other.size());
+    int i = 0;
+    while (i < n && sameEntry(entries[i], other.entries[i]))
+        i++;
+    return i;
+}
+
+void AnnotationHistory::writeEntries(QDataStream &stream, int from) const {
+    Q_ASSERT(decoded && 0 <= from && from <= size());
+    stream << (quint32)(cursor + 1 - from);
+    QDataStream::Version streamVersion = static_cast<QDataStream::Version>(stream.version());
+    stream.setVersion(QDataStream::Qt_5_2);
+    for (int i = from; i <= cursor; i++)
+        writeEntry(stream, entries[i]);
+    stream.setVersion(streamVersion);
+}
+
+bool AnnotationHistory::readEntries(QDataStream &stream, int keep) {
+    Q_ASSERT(decoded);
+    if (keep < 0 || keep > size()) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return false;
+    }
+    packed.clear();
+    appended.clear();
+    if (keep < size()) {
+        cursor = keep - 1;
+        head = cursor >= 0 ? stateAt(cursor) : ImageAnnotation();
+    }
+    entries.resize(keep);
+    quint32 count;
+    stream >> count;
+    QDataStream::Version streamVersion = static_cast<QDataStream::Version>(stream.version());
+    stream.setVersion(QDataStream::Qt_5_2);
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        Entry entry;
+        // 第一步必须是检查点
+        if (!readEntry(stream, entry) || (entries.isEmpty() && !entry.checkpoint)) {
+            stream.setStatus(QDataStream::ReadCorruptData);
+            break;
+        }
+        entries.append(entry);
+        apply(entry, head);
+    }
+    stream.setVersion(streamVersion);
+    cursor = entries.size() - 1;
+    return stream.status() == QDataStream::Ok;
+}
+
+void AnnotationHistory::writeDelta(QDataStream &stream, ImageAnnotation const &from, ImageAnnotation const &to) {
+    QDataStream::Version streamVersion = static_cast<QDataStream::Version>(stream.version());
+    stream.setVersion(QDataStream::Qt_5_2);
+    writeEntry(stream, makeDelta(from, to));
+    stream.setVersion(streamVersion);
+}
+
+bool AnnotationHistory::readDelta(QDataStream &stream, ImageAnnotation &anno) {
+    QDataStream::Version streamVersion = static_cast<QDataStream::Version>(stream.version());
+    stream.setVersion(QDataStream::Qt_5_2);
+    Entry entry;
+    bool ok = readEntry(stream, entry);
+    stream.setVersion(streamVersion);
+    if (ok)
+        apply(entry, anno);
+    return ok;
+}
+
+bool AnnotationHistory::isEmpty() const {
+    return cursor < 0;
+}
+
+int AnnotationHistory::size() const {
+    return cursor + 1;
+}
+
+void AnnotationHistory::push(ImageAnnotation const &anno) {
+    Q_ASSERT(decoded);
+    packed.clear();
+    appended.clear();
+    entries.resize(cursor + 1);
+    entries.append(makeEntry(anno));
+    cursor++;
+    head = anno;
+}
+
+void AnnotationHistory::replaceLast(ImageAnnotation const &anno) {
+    Q_ASSERT(decoded);
+    packed.clear();
+    appended.clear();
+    entries.resize(cursor + 1);
+    if (cursor >= 0) {
+        entries.removeLast();
+        cursor--;
+        head = cursor >= 0 ? stateAt(cursor) : ImageAnnotation();
+    }
+    push(anno);
+}
+
+ImageAnnotation const &AnnotationHistory::current() const {
+    return head;
+}
+
+bool AnnotationHistory::canUndo() const {
+    return cursor > 0;
+}
+
+bool AnnotationHistory::canRedo() const {
+    return cursor + 1 < entries.size();
+}
+
+ImageAnnotation const &AnnotationHistory::undo() {
+    Q_ASSERT(decoded && canUndo());
+    packed.clear();
+    appended.clear();
+    cursor--;
+    head = stateAt(cursor);
+    return head;
+}
+
+ImageAnnotation const &AnnotationHistory::redo() {
+    Q_ASSERT(decoded && canRedo());
+    packed.clear();
+    appended.clear();
+    cursor++;
+    apply(entries[cursor], head);
+    return head;
+}
+
+AnnotationHistory::Entry AnnotationHistory::makeEntry(ImageAnnotation const &anno) const {
+    if (cursor >= 0 && cursor - checkpointBefore(cursor) + 1 < CHECKPOINT_INTERVAL)
+        return makeDelta(head, anno);
+    Entry entry;
+    entry.anno = anno;
+    return entry;
+}
+
+int AnnotationHistory::checkpointBefore(int index) const {
+    while (index > 0 && !entries[index].checkpoint)
+        index--;
+    return index;
+}
+
+ImageAnnotation AnnotationHistory::stateAt(int index) const {
+    int first = checkpointBefore(index);
+    ImageAnnotation anno(entries[first].anno);
+    for (int i = first + 1; i <= index; i++)
+        apply(entries[i], anno);
+    return anno;
+}
+
+AnnotationHistory::Entry AnnotationHistory::makeDelta(ImageAnnotation const &from, ImageAnnotation const &to) {
+    Entry entry;
+    entry.blockCount = to.blocks.size();
+    entry.focusPoint = to.focusPoint;
+    for (int i = 0; i < to.blocks.size(); i++)
+        if (i >= from.blocks.size() || to.blocks[i] != from.blocks[i])
+            entry.blocks.append(qMakePair(i, to.blocks[i]));
+    // 所有块都变了时增量并不比完整的标注小
+    entry.checkpoint = entry.blocks.size() == to.blocks.size() && !to.blocks.isEmpty();
+    if (entry.checkpoint) {
+        entry.anno = to;
+        entry.blocks.clear();
+    }
+    return entry;
+}
+
+bool AnnotationHistory::sameEntry(Entry const &a, Entry const &b) {
+    if (a.checkpoint != b.checkpoint)
+        return false;
+    if (a.checkpoint)
+        return a.anno == b.anno;
+    return a.blockCount == b.blockCount && a.focusPoint == b.focusPoint && a.blocks == b.blocks;
+}
+
+void AnnotationHistory::writeEntry(QDataStream &stream, Entry const &entry) {
+    stream << (quint8)entry.checkpoint;
+    if (entry.checkpoint) {
+        stream << entry.anno;
+        return;
+    }
+    stream << (qint32)entry.blockCount;
+    stream << entry.focusPoint;
+    stream << (quint32)entry.blocks.size();
+    for (int j = 0; j < entry.blocks.size(); j++) {
+        stream << (qint32)entry.blocks[j].first;
+        stream << entry.blocks[j].second;
+    }
+}
+
+bool AnnotationHistory::readEntry(QDataStream &stream, Entry &entry) {
+    quint8 checkpoint;
+    stream >> checkpoint;
+    entry.checkpoint = checkpoint != 0;
+    if (entry.checkpoint) {
+        stream >> entry.anno;
+        return stream.status() == QDataStream::Ok;
+    }
+    qint32 blockCount;
+    quint32 n;
+    stream >> blockCount;
+    stream >> entry.focusPoint;
+    stream >> n;
+    if (blockCount < 0)
+        stream.setStatus(QDataStream::ReadCorruptData);
+    entry.blockCount = blockCount;
+    for (quint32 j = 0; j < n && stream.status() == QDataStream::Ok; j++) {
+        qint32 index;
+        BlockAnnotation block;
+        stream >> index;
+        stream >> block;
+        if (index < 0 || index >= blockCount)
+            stream.setStatus(QDataStream::ReadCorruptData);
+        entry.blocks.append(qMakePair((int)index, block));
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+void AnnotationHistory::apply(Entry const &entry, ImageAnnotation &anno) {
+    if (entry.checkpoint) {
+        anno = entry.anno;
+        return;
+    }
+    anno.blocks.resize(entry.blockCount);
+    for (int i = 0; i < entry.blocks.size(); i++)
+        anno.blocks[entry.blocks[i].first] = entry.blocks[i].second;
+    anno.focusPoint = entry.focusPoint;
+}
+
+QDataStream &operator <<(QDataStream &stream, AnnotationHistory const &history) {
+    stream << (quint32)AnnotationHistory::MAGIC;
+    stream << (quint32)AnnotationHistory::VERSION;
+    history.writeEntries(stream, 0);
+    return stream;
+}
+
+QDataStream &operator >>(QDataStream &stream, AnnotationHistory &history) {
+    history.clear();
+    quint32 magic;
+    stream >> magic;
+    if (magic != (quint32)AnnotationHistory::MAGIC) {
+        // 旧格式：QVector<ImageAnnotation>，开头是元素个数
+        for (quint32 i = 0; i < magic && stream.status() == QDataStream::Ok; i++) {
+            ImageAnnotation anno;
+            stream >> anno;
+            if (stream.status() == QDataStream::Ok)
+                history.push(anno);
+        }
+        return stream;
+    }
+    quint32 version;
+    stream >> version;
+    if (version != (quint32)AnnotationHistory::VERSION) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return stream;
+    }
+    if (!history.readEntries(stream, 0))
+        history.clear();
+    return stream;
+}
@@ -0,0 +1,93 @@
+#ifndef ANNOTATIONHISTORY_H
+#define ANNOTATIONHISTORY_H
+
+#include <QVector>
+#include <QPair>
+#include <QByteArray>
+#include <QPointF>
+#include "imageannotation.h"
+
+QT_BEGIN_NAMESPACE
+class QDataStream;
+QT_END_NAMESPACE
+
+// 撤销/重做用的历史记录。每一步只记录与上一步相比发生变化的块，
+// 每隔 CHECKPOINT_INTERVAL 步保存一次完整的标注，回退时从最近的检查点重放
+class AnnotationHistory {
+public:
+    enum { CHECKPOINT_INTERVAL = 32 };
+    enum { MAGIC = 0x48495354, VERSION = 1 }; // 序列化格式，旧格式是 QVector<ImageAnnotation>
+
+public:
+    AnnotationHistory();
+
+    void clear();
+    // 先只保存 .stream 中压缩的历史数据，用到时再解码；解码失败时只保留 fallback 一步
+    // journal 是日志中追加的历史记录，解码时依次应用
+    void setCompressed(QByteArray const &data, ImageAnnotation const &fallback,
+                       QVector<QByteArray> const &journal = QVector<QByteArray>());
+    bool isDecoded() const;
+    bool decode();
+    // 解码后没有改动过则原样返回读入的数据；有追加的记录时合并后重新压缩，结果缓存到改动为止。
+    // 无法解码时 ok 为 false，返回的只有 fallback 一步，调用者不应用它覆盖原来的数据
+    QByteArray compressed(bool *ok = nullptr) const;
+    // 都没有改动过且读入的数据相同
+    bool isSameAs(AnnotationHistory const &other) const;
+    // 两者开头相同的步数，都需已解码
+    int commonPrefix(AnnotationHistory const &other) const;
+    // 写入从 from 到当前位置的步；读取时先只保留前 keep 步再追加
+    void writeEntries(QDataStream &stream, int from) const;
+    bool readEntries(QDataStream &stream, int keep);
+    // 只包含变化的块的增量，用于日志中的标注记录
+    static void writeDelta(QDataStream &stream, ImageAnnotation const &from, ImageAnnotation const &to);
+    static bool readDelta(QDataStream &stream, ImageAnnotation &anno);
+    bool isEmpty() const;
+    int size() const; // 当前位置及之前的步数，即 undo 栈的深度
+
+    // 在当前位置之后追加一步，丢弃可以 redo 的记录
+    void push(ImageAnnotation const &anno);
+    // 用 anno 替换当前这一步
+    void replaceLast(ImageAnnotation const &anno);
+
+    ImageAnnotation const &current() const;
+    bool canUndo() const;
+    bool canRedo() const;
+    ImageAnnotation const &undo();
+    ImageAnnotation const &redo();
+
+    // 只保存到当前位置，与原先只保存 undo 栈的行为一致
+    friend QDataStream &operator <<(QDataStream &stream, AnnotationHistory const &history);
+    // 也能读取旧的 QVector<ImageAnnotation> 格式
+    friend QDataStream &operator >>(QDataStream &stream, AnnotationHistory &history);
+
+private:
+    struct Entry {
+        Entry() : checkpoint(true), blockCount(0) {}
+
+        bool checkpoint;
+        ImageAnnotation anno;                        // 检查点：完整的标注
+        int blockCount;                              // 增量：块数
+        QPointF focusPoint;                          // 增量：焦点
+        QVector<QPair<int, BlockAnnotation> > blocks; // 增量：变化的块
+    };
+
+    Entry makeEntry(ImageAnnotation const &anno) const;
+    int checkpointBefore(int index) const;
+    ImageAnnotation stateAt(int index) const;
+    static Entry makeDelta(ImageAnnotation const &from, ImageAnnotation const &to);
+    static bool sameEntry(Entry const &a, Entry const &b);
+    static void writeEntry(QDataStream &stream, Entry const &entry);
+    static bool readEntry(QDataStream &stream, Entry &entry);
+    static void apply(Entry const &entry, ImageAnnotation &anno);
+
+private:
+    QVector<Entry> entries;
+    int cursor;           // 当前所在的步，-1 表示为空
+    ImageAnnotation head; // cursor 处的标注；未解码时是 fallback
+    bool decoded;
+    QByteArray packed;    // 读入的压缩数据，历史记录改动后清空
+    QVector<QByteArray> appended;
+    mutable QByteArray merged; // packed 与 appended 合并后重新压缩的结果
+};
+
+#endif // ANNOTATIONHISTORY_H
@@ -0,0 +1,101 @@
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QFileInfo>
+#include "annotationwriter.h"
+
+class AnnotationWriter::Runner : public QRunnable {
+public:
+    Runner(AnnotationWriter *writer): writer(writer) { }
+    void run() {
+        writer->writeNext();
+    }
+private:
+    AnnotationWriter *writer;
+};
+
+/// AnnotationWriter
+
+AnnotationWriter::AnnotationWriter(QObject *parent)
+    : QObject(parent)
+{
+    // 只用一个线程，保证同一文件的写入顺序
+    pool.setMaxThreadCount(1);
+}
+
+AnnotationWriter::~AnnotationWriter() {
+    flush();
+}
+
+void AnnotationWriter::write(QString const &fileName, ImageAnnotation const &anno, AnnotationHistory const &history) {
+    QMutexLocker locker(&mutex);
+    Task task;
+    task.anno = anno;
+    task.history = history;
+    if (!tasks.contains(fileName))
+        queue.append(fileName);
+    tasks.insert(fileName, task);
+    pool.start(new Runner(this));
+}
+
+void AnnotationWriter::waitFor(QString const &fileName) {
+    QMutexLocker locker(&mutex);
+    while (writing == fileName || tasks.contains(fileName))
+        idle.wait(&mutex);
+}
+
+void AnnotationWriter::flush() {
+    pool.waitForDone();
+}
+
+void AnnotationWriter::writeNext() {
+    QString fileName;
+    Task task;
+    {
+        QMutexLocker locker(&mutex);
+        if (queue.isEmpty())
+            return; // 快照已被合并到之前的任务中
+        fileName = queue.takeFirst();
+        task = tasks.take(fileName);
+        writing = fileName;
+    }
+    QString errorMessage;
+    bool ok = writeFile(fileName, task, &errorMessage);
+    {
+        QMutexLocker locker(&mutex);
+        writing.clear();
+        idle.wakeAll();
+    }
+    if (!ok)
+        emit writeFailed(errorMessage);
+}
+
+bool AnnotationWriter::writeFile(QString const &fileName, Task const &task, QString *errorMessage) {
+    QFileInfo info(fileName);
+    QMap<QString, AnnotationFile::Journal>::iterator it = journals.find(fileName);
+    if (it == journals.end() || !info.exists() || info.size() != it->size || info.lastModified() != it->lastModified) {
+        // 没有缓存或文件被改动过，重新读取
+        AnnotationFile::Journal journal;
+        journals.remove(fileName);
+        if (info.exists() && AnnotationFile::readJournal(fileName, journal) == AnnotationFile::Ok && journal.size >= 0) {
+            if (journals.size() >= MAX_CACHED_JOURNALS)
+                journals.erase(journals.begin());
+            it = journals.insert(fileName, journal);
+        } else {
+            it = journals.end();
+        }
+    }
+    if (it != journals.end() && it->records < MAX_JOURNAL_RECORDS
+            && it->size - it->baseSize <= it->baseSize) {
+        if (AnnotationFile::append(fileName, it.value(), task.anno, task.history, errorMessage))
+            return true;
+    }
+    // 新文件、旧格式或日志过长时整体重写
+    journals.remove(fileName);
+    AnnotationFile::Journal journal;
+    if (!AnnotationFile::write(fileName, task.anno, task.history, errorMessage, &journal))
+        return false;
+    if (journals.size() >= MAX_CACHED_JOURNALS)
+        journals.erase(journals.begin());
+    journals.insert(fileName, journal);
+    return true;
+}
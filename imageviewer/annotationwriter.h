@@ -0,0 +1,55 @@
+#ifndef ANNOTATIONWRITER_H
+#define ANNOTATIONWRITER_H
+
+#include <QObject>
+#include <QMap>
+#include <QStringList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include "imageannotation.h"
+#include "annotationhistory.h"
+#include "annotationfile.h"
+
+// 在后台线程按提交顺序写入标注文件，写入失败时发出 writeFailed。
+// 平时只在日志末尾追加变化的部分，日志过长时整体重写
+class AnnotationWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    AnnotationWriter(QObject *parent = 0);
+    ~AnnotationWriter();
+
+    // 保存一份快照；同一文件尚未开始写的旧快照会被替换
+    void write(QString const &fileName, ImageAnnotation const &anno, AnnotationHistory const &history);
+    // 阻塞直到该文件没有排队或正在进行的写入（可在任意线程调用）
+    void waitFor(QString const &fileName);
+    // 阻塞直到所有写入完成
+    void flush();
+
+signals:
+    void writeFailed(QString message);
+
+private:
+    struct Task {
+        ImageAnnotation anno;
+        AnnotationHistory history;
+    };
+    class Runner;
+    void writeNext();
+    bool writeFile(QString const &fileName, Task const &task, QString *errorMessage);
+
+    enum { MAX_JOURNAL_RECORDS = 64, MAX_CACHED_JOURNALS = 8 };
+
+private:
+    QThreadPool pool;
+    QMutex mutex;
+    QWaitCondition idle;
+    QStringList queue;          // 等待写入的文件，按提交顺序
+    QMap<QString, Task> tasks;  // 文件 -> 最新快照
+    QString writing;            // 正在写入的文件
+    QMap<QString, AnnotationFile::Journal> journals; // 最近写过的文件在磁盘上的内容，只在写线程中访问
+};
+
+#endif // ANNOTATIONWRITER_H
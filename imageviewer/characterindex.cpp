@@ -0,0 +1,156 @@
+#include <QtMath>
+#include <algorithm>
+#include "characterindex.h"
+
+/// CharacterIndex
+
+CharacterIndex::CharacterIndex(qreal cellSize)
+    : cellSize(cellSize), valid(false), entryCount(0) {
+}
+
+void CharacterIndex::rebuild(ImageAnnotation const &anno) {
+    blocks.clear();
+    cells.clear();
+    oversized.clear();
+    entryCount = 0;
+    sync(anno);
+}
+
+void CharacterIndex::sync(ImageAnnotation const &anno) {
+    while (blocks.size() > anno.blocks.size())
+        removeBlock(blocks.size() - 1);
+    for (int i = 0; i < anno.blocks.size(); i++) {
+        QVector<CharacterAnnotation> const &characters(anno.blocks[i].characters);
+        if (i < blocks.size()) {
+            // 索引里保存的是浅拷贝，块被修改过就一定已经分离，数据指针不再相同
+            QVector<CharacterAnnotation> const &indexed(blocks[i].characters);
+            if (indexed.size() == characters.size() && indexed.constData() == characters.constData())
+                continue;
+            removeBlock(i);
+        }
+        insertBlock(i, characters);
+    }
+    valid = true;
+}
+
+void CharacterIndex::invalidate() {
+    valid = false;
+}
+
+bool CharacterIndex::isValid() const {
+    return valid;
+}
+
+QVector<CharacterIndex::Key> CharacterIndex::query(QRectF const &rect) const {
+    QVector<Key> res;
+    int cx0 = cellCoord(rect.left()), cx1 = cellCoord(rect.right());
+    int cy0 = cellCoord(rect.top()), cy1 = cellCoord(rect.bottom());
+    if ((qint64)(cx1 - cx0 + 1) * (cy1 - cy0 + 1) >= entryCount) {
+        // 区域覆盖的格子比字符还多，直接逐个检查
+        for (int i = 0; i < blocks.size(); i++)
+            for (int j = 0; j < blocks[i].bounds.size(); j++)
+                if (overlaps(blocks[i].bounds[j], rect))
+                    res.append(qMakePair(i, j));
+        return res;
+    }
+    QVector<Key> candidates(oversized);
+    for (int cy = cy0; cy <= cy1; cy++) {
+        for (int cx = cx0; cx <= cx1; cx++) {
+            QHash<quint64, QVector<Key> >::const_iterator it = cells.find(cellKey(cx, cy));
+            if (it != cells.end())
+                candidates += it.value();
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    foreach (Key const &key, candidates)
+        if (overlaps(bound(key), rect))
+            res.append(key);
+    return res;
+}
+
+QVector<CharacterIndex::Key> CharacterIndex::query(QPointF const &p) const {
+    QVector<Key> res;
+    QRectF rect(p, p);
+    foreach (Key const &key, cells.value(cellKey(cellCoord(p.x()), cellCoord(p.y()))))
+        if (overlaps(bound(key), rect))
+            res.append(key);
+    foreach (Key const &key, oversized)
+        if (overlaps(bound(key), rect))
+            res.append(key);
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+void CharacterIndex::insertBlock(int i, QVector<CharacterAnnotation> const &characters) {
+    if (i == blocks.size())
+        blocks.append(Block());
+    Block &block(blocks[i]);
+    block.characters = characters;
+    block.bounds.resize(characters.size());
+    for (int j = 0; j < characters.size(); j++) {
+        QRectF const &bound(block.bounds[j] = characters[j].box.boundingRect());
+        Key key(i, j);
+        if (isOversized(bound)) {
+            oversized.append(key);
+            continue;
+        }
+        for (int cy = cellCoord(bound.top()); cy <= cellCoord(bound.bottom()); cy++)
+            for (int cx = cellCoord(bound.left()); cx <= cellCoord(bound.right()); cx++)
+                cells[cellKey(cx, cy)].append(key);
+    }
+    entryCount += characters.size();
+}
+
+void CharacterIndex::removeBlock(int i) {
+    Block &block(blocks[i]);
+    auto inBlock = [i](Key const &key) { return key.first == i; };
+    bool hasOversized = false;
+    foreach (QRectF const &bound, block.bounds) {
+        if (isOversized(bound)) {
+            hasOversized = true;
+            continue;
+        }
+        for (int cy = cellCoord(bound.top()); cy <= cellCoord(bound.bottom()); cy++) {
+            for (int cx = cellCoord(bound.left()); cx <= cellCoord(bound.right()); cx++) {
+                QHash<quint64, QVector<Key> >::iterator it = cells.find(cellKey(cx, cy));
+                if (it == cells.end())
+                    continue; // 同一块中的字共用格子，已经删过了
+                it.value().erase(std::remove_if(it.value().begin(), it.value().end(), inBlock), it.value().end());
+                if (it.value().isEmpty())
+                    cells.erase(it);
+            }
+        }
+    }
+    if (hasOversized)
+        oversized.erase(std::remove_if(oversized.begin(), oversized.end(), inBlock), oversized.end());
+    entryCount -= block.bounds.size();
+    if (i == blocks.size() - 1) {
+        blocks.removeLast();
+    } else {
+        block.characters.clear();
+        block.bounds.clear();
+    }
+}
+
+bool CharacterIndex::isOversized(QRectF const &bound) const {
+    return cellCoord(bound.right()) - cellCoord(bound.left()) >= MAX_CELL_SPAN
+            || cellCoord(bound.bottom()) - cellCoord(bound.top()) >= MAX_CELL_SPAN;
+}
+
+QRectF const &CharacterIndex::bound(Key const &key) const {
+    return blocks[key.first].bounds[key.second];
+}
+
+bool CharacterIndex::overlaps(QRectF const &a, QRectF const &b) {
+    // 与 QRectF::intersects 不同，宽或高为 0 的包围盒也算相交
+    return a.left() <= b.right() && b.left() <= a.right() && a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+quint64 CharacterIndex::cellKey(int cx, int cy) {
+    return ((quint64)(quint32)cx << 32) | (quint32)cy;
+}
+
+int CharacterIndex::cellCoord(qreal v) const {
+    return qFloor(qBound((qreal)-1e9, v, (qreal)1e9) / cellSize);
+}
@@ -0,0 +1,53 @@
+#ifndef CHARACTERINDEX_H
+#define CHARACTERINDEX_H
+
+#include <QVector>
+#include <QHash>
+#include <QPair>
+#include <QRectF>
+#include "imageannotation.h"
+
+// 字符包围盒的均匀网格索引，用于快速查询落在某个区域内的字符
+class CharacterIndex {
+public:
+    typedef QPair<int, int> Key; // (block, character)
+
+public:
+    CharacterIndex(qreal cellSize = 64.0);
+
+    void rebuild(ImageAnnotation const &anno);
+    // 只重新索引内容发生变化的块
+    void sync(ImageAnnotation const &anno);
+    void invalidate();
+    bool isValid() const;
+
+    // 返回包围盒与 rect 相交的字符，按 (block, character) 升序
+    QVector<Key> query(QRectF const &rect) const;
+    // 返回包围盒包含 p 的字符，按 (block, character) 升序
+    QVector<Key> query(QPointF const &p) const;
+
+private:
+    struct Block {
+        QVector<CharacterAnnotation> characters; // 浅拷贝，用于判断块是否被修改过
+        QVector<QRectF> bounds;
+    };
+    enum { MAX_CELL_SPAN = 64 }; // 跨越过多格子的包围盒单独存放
+
+    void insertBlock(int i, QVector<CharacterAnnotation> const &characters);
+    void removeBlock(int i);
+    bool isOversized(QRectF const &bound) const;
+    QRectF const &bound(Key const &key) const;
+    static bool overlaps(QRectF const &a, QRectF const &b);
+    static quint64 cellKey(int cx, int cy);
+    int cellCoord(qreal v) const;
+
+private:
+    qreal cellSize;
+    bool valid;
+    int entryCount;
+    QVector<Block> blocks;
+    QHash<quint64, QVector<Key> > cells;
+    QVector<Key> oversized;
+};
+
+#endif // CHARACTERINDEX_H
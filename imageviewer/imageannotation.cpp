@@ -3,6 +3,92 @@
 #include <QDebug>
 #include "imageannotation.h"
 
+/// Character Props
+
+static QString const propNames[CharacterProps::NUM_IDS] = {
+    "covered", "bgcomplex", "raised", "perspective", "wordart", "handwritten", "pass", "mask"
+};
+
+int CharacterProps::idOf(QString const &key) {
+    for (int id = 0; id < NUM_IDS; id++)
+        if (propNames[id] == key)
+            return id;
+    return -1;
+}
+
+QString const &CharacterProps::nameOf(int id) {
+    Q_ASSERT(0 <= id && id < NUM_IDS);
+    return propNames[id];
+}
+
+void CharacterProps::insert(Id id, int value) {
+    if (value == 1) {
+        bits |= 1u << id;
+        if (!others.isEmpty())
+            others.remove(nameOf(id));
+    } else {
+        bits &= ~(1u << id);
+        others.insert(nameOf(id), value);
+    }
+}
+
+void CharacterProps::remove(Id id) {
+    bits &= ~(1u << id);
+    if (!others.isEmpty())
+        others.remove(nameOf(id));
+}
+
+int CharacterProps::value(QString const &key, int defaultValue) const {
+    int id = idOf(key);
+    if (id >= 0)
+        return value(static_cast<Id>(id), defaultValue);
+    return others.value(key, defaultValue);
+}
+
+bool CharacterProps::contains(QString const &key) const {
+    int id = idOf(key);
+    if (id >= 0)
+        return contains(static_cast<Id>(id));
+    return others.contains(key);
+}
+
+void CharacterProps::insert(QString const &key, int value) {
+    int id = idOf(key);
+    if (id >= 0)
+        insert(static_cast<Id>(id), value);
+    else
+        others.insert(key, value);
+}
+
+void CharacterProps::remove(QString const &key) {
+    int id = idOf(key);
+    if (id >= 0)
+        remove(static_cast<Id>(id));
+    else
+        others.remove(key);
+}
+
+QMap<QString, int> CharacterProps::toMap() const {
+    QMap<QString, int> map(others);
+    for (int id = 0; id < NUM_IDS; id++)
+        if (bits & (1u << id))
+            map.insert(propNames[id], 1);
+    return map;
+}
+
+CharacterProps CharacterProps::fromMap(QMap<QString, int> const &map) {
+    CharacterProps props;
+    for (QMap<QString, int>::const_iterator it = map.begin(); it != map.end(); ++it)
+        props.insert(it.key(), it.value());
+    return props;
+}
+
+/// Character Annotation
+
+bool CharacterAnnotation::operator ==(CharacterAnnotation const &other) const {
+    return box == other.box && text == other.text && props == other.props;
+}
+
 /// Perspective Helper
 
 PerspectiveHelper::PerspectiveHelper() {
@@ -17,6 +103,16 @@ PerspectiveHelper::PerspectiveHelper() {
     lastPointInvalid = false;
 }
 
+bool PerspectiveHelper::operator ==(PerspectiveHelper const &other) const {
+    if (numPoint != other.numPoint)
+        return false;
+    for (size_t i = 0; i < sizeof(points) / sizeof(*points); i++)
+        if (points[i] != other.points[i])
+            return false;
+    return stroke == other.stroke && toolSwitched == other.toolSwitched && stroking == other.stroking
+            && singleCharacter == other.singleCharacter && textDirection == other.textDirection;
+}
+
 void PerspectiveHelper::onStartPoint(QPointF p, qreal scale, bool regular, BlockAnnotation *block) {
     setPoint(p, scale, regular, block, false);
 }
@@ -115,9 +211,9 @@ void PerspectiveHelper::setPoint(QPointF p, qreal scale, bool regular, BlockAnno
             if (!pending) {
                 if (textDirection == DIRECTION_AUTO)
                     textDirection = detectTextDirection(stroke);
-                QVector<QPolygonF> characterPoly = getPendingCharacterPoly();
-                if (!characterPoly.empty())
-                    addNewCharacterBoxToBlock(characterPoly.first(), block);
+                Quad characterPoly;
+                if (pendingCharacterPoly(characterPoly))
+                    addNewCharacterBoxToBlock(characterPoly, block);
                 stroking = false;
             }
         }
@@ -126,15 +222,22 @@ void PerspectiveHelper::setPoint(QPointF p, qreal scale, bool regular, BlockAnno
 
 QVector<QPolygonF> PerspectiveHelper::getHelperPoly() const {
     if (numPoint > 0)
-        return QVector<QPolygonF>({poly()});
+        return QVector<QPolygonF>({poly().toPolygon()});
     else
         return QVector<QPolygonF>();
 }
 
 QVector<QPolygonF> PerspectiveHelper::getPendingCharacterPoly() const {
+    Quad characterPoly;
+    if (pendingCharacterPoly(characterPoly))
+        return {characterPoly.toPolygon()};
+    return QVector<QPolygonF>();
+}
+
+bool PerspectiveHelper::pendingCharacterPoly(Quad &characterPoly) const {
     if (!stroking)
-        return QVector<QPolygonF>();
-    QPolygonF bound = poly();
+        return false;
+    Quad bound = poly();
     TextDirection textDirection = this->textDirection;
     if (textDirection == DIRECTION_AUTO)
         textDirection = detectTextDirection(stroke);
@@ -168,10 +271,11 @@ QVector<QPolygonF> PerspectiveHelper::getPendingCharacterPoly() const {
         bottom.intersect(l2, &p2);
         up.intersect(l2, &p3);
         up.intersect(l1, &p4);
-        return {QPolygonF({p1, p2, p3, p4})};
+        characterPoly = Quad(p1, p2, p3, p4);
+        return true;
     }
     Q_ASSERT(false);
-    return QVector<QPolygonF>();
+    return false;
 }
 
 QString PerspectiveHelper::getTips() const {
@@ -190,25 +294,25 @@ QString PerspectiveHelper::getTips() const {
     return tips;
 }
 
-QPolygonF PerspectiveHelper::poly() const {
+Quad PerspectiveHelper::poly() const {
     QLineF base(points[0], points[1]);
     QLineF top(points[2], points[3]);
     QLineF left(points[0], points[2]);
     QLineF right(points[1], points[3]);
     QPointF intersect;
     if (base.intersect(top, &intersect) == QLineF::BoundedIntersection)
-        return QPolygonF({points[0], points[2], points[1], points[3]});
+        return Quad(points[0], points[2], points[1], points[3]);
     else if (left.intersect(right, &intersect) == QLineF::BoundedIntersection)
-        return QPolygonF({points[0], points[1], points[2], points[3]});
+        return Quad(points[0], points[1], points[2], points[3]);
     else
-        return QPolygonF({points[0], points[1], points[3], points[2]});
+        return Quad(points[0], points[1], points[3], points[2]);
 
 }
 
 PerspectiveHelper::TextDirection PerspectiveHelper::detectTextDirection(QLineF stroke) const {
     if (stroke.p1() == stroke.p2())
         stroke.setP2(stroke.p1() + QPointF(1, 0));
-    QPolygonF bound = poly();
+    Quad bound = poly();
     QLineF horiDir = QLineF((bound[0] + bound[3]) / 2, (bound[1] + bound[2]) / 2).unitVector();
     QLineF vertDir = QLineF((bound[0] + bound[1]) / 2, (bound[2] + bound[3]) / 2).unitVector();
     if (qAbs(stroke.dx() * horiDir.dx() + stroke.dy() * horiDir.dy()) * 1.2 >=
@@ -221,7 +325,7 @@ PerspectiveHelper::TextDirection PerspectiveHelper::detectTextDirection(QLineF s
 bool PerspectiveHelper::isHorizontalText(QLineF stroke) const {
     if (numPoint < 4)
         return false;
-    QPolygonF bound = poly();
+    Quad bound = poly();
     TextDirection textDirection = this->textDirection;
     if (textDirection == DIRECTION_AUTO)
         textDirection = detectTextDirection(stroke);
@@ -243,15 +347,22 @@ bool PerspectiveHelper::isHorizontalText(QLineF stroke) const {
     return false;
 }
 
-void PerspectiveHelper::addNewCharacterBoxToBlock(QPolygonF poly, BlockAnnotation *block) {
+void PerspectiveHelper::addNewCharacterBoxToBlock(Quad const &poly, BlockAnnotation *block) {
     CharacterAnnotation charAnno;
-    charAnno.box = poly;
+    charAnno.box = poly.toPolygon();
     charAnno.text = QString("");
     block->characters.push_back(charAnno);
 }
 
 /// Block Annotation
 
+bool BlockAnnotation::operator ==(BlockAnnotation const &other) const {
+    if (helperType != other.helperType || perspectiveHelper != other.perspectiveHelper)
+        return false;
+    // 未修改过的块与历史记录共享同一份数据，不必逐字比较
+    return characters.constData() == other.characters.constData() || characters == other.characters;
+}
+
 bool BlockAnnotation::isStringOk() const {
     foreach (CharacterAnnotation const &charAnno, characters)
         if (charAnno.text.size() != 1)
@@ -295,7 +406,7 @@ QString BlockAnnotation::onMask() {
         if (!perspectiveHelper.onEnterPressed(this)) {
             res = QObject::tr("请在完成4个顶点时标记mask。不能在已框文字后标记mask");
         } else {
-            characters.first().props["mask"] = 1;
+            characters.first().props.insert(CharacterProps::MASK, 1);
             res = QString("");
         }
     }
@@ -305,14 +416,16 @@ QString BlockAnnotation::onMask() {
 QDataStream &operator <<(QDataStream &stream, CharacterAnnotation const &anno) {
     stream << anno.box;
     stream << anno.text;
-    stream << anno.props;
+    stream << anno.props.toMap();
     return stream;
 }
 
 QDataStream &operator >>(QDataStream &stream, CharacterAnnotation &anno) {
     stream >> anno.box;
     stream >> anno.text;
-    stream >> anno.props;
+    QMap<QString, int> props;
+    stream >> props;
+    anno.props = CharacterProps::fromMap(props);
     return stream;
 }
 
@@ -7,18 +7,64 @@
 #include <QPolygonF>
 #include <QLineF>
 #include <QQueue>
+#include "quad.h"
 
 class CharacterAnnotation;
 class PerspectiveHelper;
 class BlockAnnotation;
 class ImageAnnotation;
 
+// 字的属性，接口与序列化格式同 QMap<QString, int>。
+// 已知属性取值为 1 时只占一位，其他取值和未知属性才放进 QMap
+class CharacterProps {
+public:
+    // 顺序与属性面板中的复选框一致
+    enum Id { COVERED, BGCOMPLEX, RAISED, PERSPECTIVE, WORDART, HANDWRITTEN, PASS, MASK, NUM_IDS };
+
+public:
+    CharacterProps() : bits(0) {}
+
+    static int idOf(QString const &key); // 未知属性返回 -1
+    static QString const &nameOf(int id);
+
+    int value(Id id, int defaultValue = 0) const {
+        if (bits & (1u << id))
+            return 1;
+        return others.isEmpty() ? defaultValue : others.value(nameOf(id), defaultValue);
+    }
+    bool contains(Id id) const {
+        return (bits & (1u << id)) || (!others.isEmpty() && others.contains(nameOf(id)));
+    }
+    void insert(Id id, int value);
+    void remove(Id id);
+
+    int value(QString const &key, int defaultValue = 0) const;
+    bool contains(QString const &key) const;
+    void insert(QString const &key, int value);
+    void remove(QString const &key);
+
+    bool isEmpty() const { return bits == 0 && others.isEmpty(); }
+    QMap<QString, int> toMap() const;
+    static CharacterProps fromMap(QMap<QString, int> const &map);
+
+    bool operator ==(CharacterProps const &other) const { return bits == other.bits && others == other.others; }
+    bool operator !=(CharacterProps const &other) const { return !(*this == other); }
+
+private:
+    quint32 bits;              // 第 id 位：已知属性取值为 1
+    QMap<QString, int> others; // 其余属性，不与 bits 重复
+};
+
 // 标注一个字
 class CharacterAnnotation {
 public:
     QPolygonF box;
     QString text;
-    QMap<QString, int> props;
+    CharacterProps props;
+
+public:
+    bool operator ==(CharacterAnnotation const &other) const;
+    bool operator !=(CharacterAnnotation const &other) const { return !(*this == other); }
 };
 
 class PerspectiveHelper {
@@ -37,6 +83,8 @@ public: // Do not serialize them
 
 public:
     PerspectiveHelper();
+    bool operator ==(PerspectiveHelper const &other) const; // 只比较需要序列化的成员
+    bool operator !=(PerspectiveHelper const &other) const { return !(*this == other); }
     void onStartPoint(QPointF p, qreal scale, bool regular, BlockAnnotation *block);
     void onPendingPoint(QPointF p, qreal scale, bool regular, BlockAnnotation *block);
     int onEndPoint(QPointF, qreal, bool, BlockAnnotation *);
@@ -48,10 +96,11 @@ public:
     QString getTips() const;
 
 private:
-    QPolygonF poly() const;
+    Quad poly() const;
+    bool pendingCharacterPoly(Quad &characterPoly) const;
     TextDirection detectTextDirection(QLineF stroke) const;
     bool isHorizontalText(QLineF stroke) const;
-    void addNewCharacterBoxToBlock(QPolygonF poly, BlockAnnotation *block);
+    void addNewCharacterBoxToBlock(Quad const &poly, BlockAnnotation *block);
 };
 
 class BlockAnnotation {
@@ -66,6 +115,9 @@ public:
         helperType = PERSPECTIVE_HELPER;
     }
 
+    bool operator ==(BlockAnnotation const &other) const;
+    bool operator !=(BlockAnnotation const &other) const { return !(*this == other); }
+
     void onStartPoint(QPointF p, qreal scale, bool regular) {
         if (helperType == PERSPECTIVE_HELPER)
             perspectiveHelper.onStartPoint(p, scale, regular, this);
@@ -137,6 +189,10 @@ public:
         focusPoint = QPointF(0, 0);
     }
 
+    bool operator ==(ImageAnnotation const &other) const {
+        return focusPoint == other.focusPoint && blocks == other.blocks;
+    }
+
     friend QDataStream &operator <<(QDataStream &stream, ImageAnnotation const &anno);
     friend QDataStream &operator >>(QDataStream &stream, ImageAnnotation &anno);
 
@@ -198,4 +254,11 @@ public:
     }
 };
 
+QDataStream &operator <<(QDataStream &stream, CharacterAnnotation const &anno);
+QDataStream &operator >>(QDataStream &stream, CharacterAnnotation &anno);
+QDataStream &operator <<(QDataStream &stream, PerspectiveHelper const &helper);
+QDataStream &operator >>(QDataStream &stream, PerspectiveHelper &helper);
+QDataStream &operator <<(QDataStream &stream, BlockAnnotation const &anno);
+QDataStream &operator >>(QDataStream &stream, BlockAnnotation &anno);
+
 #endif // IMAGEANNOTATION_HPP
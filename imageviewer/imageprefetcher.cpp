@@ -0,0 +1,124 @@
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QRunnable>
+#include "imageprefetcher.h"
+
+struct ImagePrefetcher::Job {
+    Job(): writer(nullptr), cancelled(false), started(false), finished(false) { }
+    QString imageFile;
+    QString annotationFile;
+    AnnotationWriter *writer;
+    QMutex mutex;
+    QWaitCondition done;
+    bool cancelled;
+    bool started;
+    bool finished;
+    Entry entry;
+};
+
+class ImagePrefetcher::Runner : public QRunnable {
+public:
+    Runner(QSharedPointer<Job> const &job): job(job) { }
+
+    void run() {
+        {
+            QMutexLocker locker(&job->mutex);
+            if (job->cancelled) {
+                job->finished = true;
+                job->done.wakeAll();
+                return;
+            }
+            job->started = true;
+        }
+        Entry entry;
+        entry.image = QImage(job->imageFile);
+        entry.status = AnnotationFile::NotFound;
+        bool cancelled;
+        {
+            QMutexLocker locker(&job->mutex);
+            cancelled = job->cancelled;
+        }
+        if (!cancelled && !entry.image.isNull()) {
+            if (job->writer)
+                job->writer->waitFor(job->annotationFile);
+            entry.status = AnnotationFile::read(job->annotationFile, entry.anno, entry.history);
+        }
+        QMutexLocker locker(&job->mutex);
+        job->entry = entry;
+        job->finished = true;
+        job->done.wakeAll();
+    }
+
+private:
+    QSharedPointer<Job> job;
+};
+
+/// ImagePrefetcher
+
+ImagePrefetcher::ImagePrefetcher(int maxThreadCount)
+    : writer(nullptr) {
+    pool.setMaxThreadCount(maxThreadCount);
+}
+
+ImagePrefetcher::~ImagePrefetcher() {
+    clear();
+    pool.waitForDone();
+}
+
+void ImagePrefetcher::setWriter(AnnotationWriter *writer) {
+    this->writer = writer;
+}
+
+void ImagePrefetcher::prefetch(QStringList const &imageFiles, QStringList const &annotationFiles) {
+    Q_ASSERT(imageFiles.size() == annotationFiles.size());
+    QMap<QString, QSharedPointer<Job> > kept;
+    for (int i = 0; i < imageFiles.size(); i++) {
+        QSharedPointer<Job> job = jobs.take(imageFiles[i]);
+        if (!job.isNull() && job->annotationFile != annotationFiles[i]) {
+            cancel(job);
+            job.clear();
+        }
+        if (job.isNull()) {
+            job = QSharedPointer<Job>(new Job);
+            job->imageFile = imageFiles[i];
+            job->annotationFile = annotationFiles[i];
+            job->writer = writer;
+            pool.start(new Runner(job), imageFiles.size() - i);
+        }
+        kept.insert(imageFiles[i], job);
+    }
+    // 剩下的都是用户跳走后不再需要的任务
+    foreach (QSharedPointer<Job> const &job, jobs)
+        cancel(job);
+    jobs = kept;
+}
+
+bool ImagePrefetcher::take(QString const &imageFile, Entry &entry) {
+    QSharedPointer<Job> job = jobs.take(imageFile);
+    if (job.isNull())
+        return false;
+    QMutexLocker locker(&job->mutex);
+    if (!job->started) {
+        // 还在排队，直接在调用者线程加载更快
+        job->cancelled = true;
+        return false;
+    }
+    while (!job->finished)
+        job->done.wait(&job->mutex);
+    if (job->entry.image.isNull())
+        return false;
+    entry = job->entry;
+    return true;
+}
+
+void ImagePrefetcher::clear() {
+    foreach (QSharedPointer<Job> const &job, jobs)
+        cancel(job);
+    jobs.clear();
+}
+
+void ImagePrefetcher::cancel(QSharedPointer<Job> const &job) {
+    QMutexLocker locker(&job->mutex);
+    job->cancelled = true;
+}
@@ -0,0 +1,47 @@
+#ifndef IMAGEPREFETCHER_H
+#define IMAGEPREFETCHER_H
+
+#include <QMap>
+#include <QImage>
+#include <QStringList>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include "imageannotation.h"
+#include "annotationfile.h"
+#include "annotationwriter.h"
+
+// 在后台线程预先解码相邻的图片并读取它们的标注文件，翻页时直接取用
+class ImagePrefetcher {
+public:
+    struct Entry {
+        QImage image;
+        AnnotationFile::Status status;
+        ImageAnnotation anno;
+        AnnotationHistory history;
+    };
+
+public:
+    ImagePrefetcher(int maxThreadCount = 2);
+    ~ImagePrefetcher();
+
+    // 读取标注文件前先等待 writer 中该文件的写入完成
+    void setWriter(AnnotationWriter *writer);
+
+    // 设置需要预读的图片（按优先级从高到低），不在列表中的任务被取消
+    void prefetch(QStringList const &imageFiles, QStringList const &annotationFiles);
+    // 取出预读结果；任务尚未开始或失败时返回 false，由调用者自行加载
+    bool take(QString const &imageFile, Entry &entry);
+    void clear();
+
+private:
+    struct Job;
+    class Runner;
+    static void cancel(QSharedPointer<Job> const &job);
+
+private:
+    QThreadPool pool;
+    AnnotationWriter *writer;
+    QMap<QString, QSharedPointer<Job> > jobs;
+};
+
+#endif // IMAGEPREFETCHER_H
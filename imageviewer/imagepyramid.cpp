@@ -0,0 +1,111 @@
+#include <QPainter>
+#include <QtMath>
+#include <QtConcurrent>
+#include "imagepyramid.h"
+
+/// ImagePyramid
+
+ImagePyramid::ImagePyramid(QObject *parent)
+    : QObject(parent)
+{
+    connect(&watcher, SIGNAL(finished()), this, SLOT(onBuildFinished()));
+}
+
+ImagePyramid::~ImagePyramid() {
+    generation.fetchAndAddOrdered(1);
+    watcher.waitForFinished();
+}
+
+void ImagePyramid::build(QImage const &image) {
+    clear();
+    source = image;
+    if (source.isNull())
+        return;
+    int expected = generation.load();
+    watcher.setFuture(QtConcurrent::run(&ImagePyramid::buildLevels, source, &generation, expected));
+}
+
+void ImagePyramid::clear() {
+    generation.fetchAndAddOrdered(1);
+    source = QImage();
+    levels.clear();
+}
+
+bool ImagePyramid::isReady() const {
+    return !levels.isEmpty();
+}
+
+void ImagePyramid::paint(QPainter &painter, QPoint leftTop, qreal scaleFactor, QRect const &viewport) const {
+    if (source.isNull())
+        return;
+    if (levels.isEmpty()) {
+        // 金字塔尚未生成，先从原图中只取可见部分绘制
+        paintLevel(painter, makeLevel(source), leftTop, scaleFactor, viewport);
+        return;
+    }
+    // 取不小于当前缩放比例的最小一层，绘制时缩小倍数不超过 2
+    int k = 0;
+    while (k + 1 < levels.size() && (qreal)levels[k + 1].image.width() / source.width() >= scaleFactor)
+        k++;
+    bool smooth = painter.testRenderHint(QPainter::SmoothPixmapTransform);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    paintLevel(painter, levels[k], leftTop, scaleFactor, viewport);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, smooth);
+}
+
+void ImagePyramid::onBuildFinished() {
+    QVector<Level> result = watcher.result();
+    if (result.isEmpty() || result.first().image.cacheKey() != source.cacheKey())
+        return;
+    levels = result;
+    emit ready();
+}
+
+QVector<ImagePyramid::Level> ImagePyramid::buildLevels(QImage image, QAtomicInt *generation, int expected) {
+    QVector<Level> levels;
+    levels.append(makeLevel(image));
+    QImage current = image;
+    while (qMax(current.width(), current.height()) > TILE_SIZE) {
+        if (generation->load() != expected)
+            return QVector<Level>();
+        current = current.scaled(QSize(qMax(1, current.width() / 2), qMax(1, current.height() / 2)),
+                                 Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        levels.append(makeLevel(current));
+    }
+    return levels;
+}
+
+ImagePyramid::Level ImagePyramid::makeLevel(QImage const &image) {
+    Level level;
+    level.image = image;
+    level.cols = (image.width() + TILE_SIZE - 1) / TILE_SIZE;
+    level.rows = (image.height() + TILE_SIZE - 1) / TILE_SIZE;
+    return level;
+}
+
+void ImagePyramid::paintLevel(QPainter &painter, Level const &level, QPoint leftTop, qreal scaleFactor, QRect const &viewport) const {
+    int w = level.image.width();
+    int h = level.image.height();
+    if (w <= 0 || h <= 0 || scaleFactor <= 0)
+        return;
+    // 该层像素到屏幕像素的比例
+    qreal sx = scaleFactor * source.width() / w;
+    qreal sy = scaleFactor * source.height() / h;
+    int c0 = qMax(0, qFloor((viewport.left() - leftTop.x()) / (sx * TILE_SIZE)));
+    int c1 = qMin(level.cols - 1, qFloor((viewport.right() + 1 - leftTop.x()) / (sx * TILE_SIZE)));
+    int r0 = qMax(0, qFloor((viewport.top() - leftTop.y()) / (sy * TILE_SIZE)));
+    int r1 = qMin(level.rows - 1, qFloor((viewport.bottom() + 1 - leftTop.y()) / (sy * TILE_SIZE)));
+    for (int r = r0; r <= r1; r++) {
+        for (int c = c0; c <= c1; c++) {
+            QRect tile(c * TILE_SIZE, r * TILE_SIZE, qMin((int)TILE_SIZE, w - c * TILE_SIZE), qMin((int)TILE_SIZE, h - r * TILE_SIZE));
+            // 相邻块的边界取整到同一像素，避免出现缝隙
+            int x0 = leftTop.x() + qRound(tile.left() * sx);
+            int x1 = leftTop.x() + qRound((tile.left() + tile.width()) * sx);
+            int y0 = leftTop.y() + qRound(tile.top() * sy);
+            int y1 = leftTop.y() + qRound((tile.top() + tile.height()) * sy);
+            if (x1 <= x0 || y1 <= y0)
+                continue;
+            painter.drawImage(QRect(x0, y0, x1 - x0, y1 - y0), level.image, tile);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <QObject>
+#include <QVector>
+#include <QImage>
+#include <QRect>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+
+QT_BEGIN_NAMESPACE
+class QPainter;
+QT_END_NAMESPACE
+
+// 图片的多分辨率金字塔。每一层按 TILE_SIZE 切成固定大小的块，
+// 绘制时只取最接近当前缩放比例的一层，并且只绘制视口内的块
+class ImagePyramid : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum { TILE_SIZE = 256 };
+
+    struct Level {
+        QImage image; // 第 0 层即原图，之后每层长宽减半
+        int cols;
+        int rows;
+    };
+
+public:
+    ImagePyramid(QObject *parent = 0);
+    ~ImagePyramid();
+
+    void build(QImage const &image);
+    void clear();
+    bool isReady() const;
+    void paint(QPainter &painter, QPoint leftTop, qreal scaleFactor, QRect const &viewport) const;
+
+signals:
+    void ready();
+
+private slots:
+    void onBuildFinished();
+
+private:
+    static QVector<Level> buildLevels(QImage image, QAtomicInt *generation, int expected);
+    static Level makeLevel(QImage const &image);
+    void paintLevel(QPainter &painter, Level const &level, QPoint leftTop, qreal scaleFactor, QRect const &viewport) const;
+
+private:
+    QImage source;
+    QVector<Level> levels;
+    QFutureWatcher<QVector<Level> > watcher;
+    QAtomicInt generation; // 每次 build/clear 加一，过期的后台任务会提前退出
+};
+
+#endif // IMAGEPYRAMID_H
@@ -1,8 +1,10 @@
 #include <QtWidgets>
+#include <QtConcurrent>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QDebug>
 #include <functional>
+#include <algorithm>
 #include "imageviewer.h"
 
 /// ImageViewer
@@ -11,6 +13,21 @@ static QVector<QString> radioIdx2propname({
     "covered", "bgcomplex", "raised", "perspective", "wordart", "handwritten", "pass"
 });
 
+static CharacterProps::Id propIdOf(QString const &propname) {
+    int id = CharacterProps::idOf(propname);
+    Q_ASSERT(id >= 0);
+    return static_cast<CharacterProps::Id>(id);
+}
+
+// 字符框在屏幕上小于这个尺寸时只画轮廓，不画文字和底色
+static const qreal lodOutlineOnlySize = 8.0;
+
+// 字符标签排版缓存的最大条目数，超过后清空重建
+static const int maxGlyphCacheSize = 8192;
+
+// 左右翻页时在后台预读的相邻图片数（每侧）
+static const int prefetchRadius = 2;
+
 
 ImageViewer::ImageViewer(QWidget *parent)
     : QMainWindow(parent)
@@ -27,6 +44,16 @@ ImageViewer::ImageViewer(QWidget *parent)
     statusBar()->setStyleSheet(QString("QStatusBar::item{border: 0px;background:#ffd;}"));
     connect(listWidget, SIGNAL(currentRowChanged(int)), this, SLOT(onListWidgetSelect()));
     connect(listWidget, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(onListWidgetDoubleClicked(QModelIndex)));
+    imagePyramid = new ImagePyramid(this);
+    connect(imagePyramid, SIGNAL(ready()), this, SLOT(update()));
+    thumbnailCache = new ThumbnailCache(this);
+    connect(thumbnailCache, SIGNAL(updated()), this, SLOT(update()));
+    connect(&folderIndexWatcher, SIGNAL(finished()), this, SLOT(onFolderIndexed()));
+    connect(&historyWatcher, SIGNAL(finished()), this, SLOT(onHistoryDecoded()));
+    folderIndexing = false;
+    annotationWriter = new AnnotationWriter(this);
+    connect(annotationWriter, SIGNAL(writeFailed(QString)), this, SLOT(onWriteFailed(QString)));
+    prefetcher.setWriter(annotationWriter);
 
     QVBoxLayout *verticalLayout_1;
     QVBoxLayout *verticalLayout_2;
@@ -102,6 +129,7 @@ ImageViewer::ImageViewer(QWidget *parent)
     draggingImage = false;
     drawingLabel = false;
     annotationSuffix = QString("stream");
+    annotationLayerDirty = true;
     resetHistory();
     changingPerspectiveHelper = false;
     selectedPerspectiveHelperIndex = -1;
@@ -142,49 +170,23 @@ void ImageViewer::paintEvent(QPaintEvent *event) {
     QPainter painter;
     painter.begin(this);
 
-    auto paintCharacter = [&](QPolygonF const &box, QString const &text, qreal polyOpacity, qreal charBgOpacity, qreal charOpacity,
-            QColor penColor, QColor brushColor, QColor charColor, qreal penWidth) {
-        QPolygonF polyScreen = toScreenPoly(box);
-
-        // 字符包围盒
-        painter.setOpacity(polyOpacity);
-        painter.setPen(QPen(penColor, penWidth));
-        painter.setBrush(Qt::NoBrush);
-        painter.drawPolygon(polyScreen);
-
-        // 打印文字
-        if (!text.isEmpty()) {
-            painter.setOpacity(charBgOpacity);
-            painter.setPen(Qt::NoPen);
-            painter.setBrush(brushColor);
-            painter.drawPolygon(polyScreen);
-
-            painter.setOpacity(charOpacity);
-            painter.setPen(QPen(charColor));
-            painter.setBrush(Qt::NoBrush);
-            QRectF bounding = polyScreen.boundingRect();
-            qreal fontSize = qMax(qMin(bounding.width() / text.length(), bounding.height()) * 0.67, 5.0);
-            painter.setFont(QFont("Arial", fontSize, QFont::Bold));
-            painter.drawText(bounding, Qt::AlignCenter, text);
-        }
-    };
-
     if (radioButtonAnno->isChecked()) {
         // 绘制图片
-        if (!scaledImage.isNull())
-            painter.drawImage(imageLeftTop, scaledImage);
+        imagePyramid->paint(painter, imageLeftTop, scaleFactor, event->rect());
 
         // 确定选中的Block
         int listSelectedBlock = -1;
         if (!listWidget->selectedItems().isEmpty())
             listSelectedBlock = listWidget->row(listWidget->selectedItems().first());
 
-        if (!controlPressed || !shiftPressed)
+        if (!controlPressed || !shiftPressed) {
+            // 已标注的字符区域画在缓存图层里，这里只贴图
+            updateAnnotationLayer(listSelectedBlock);
+            painter.drawImage(QPoint(0, 0), annotationLayer);
+
             for (int i = 0; i < anno.blocks.size(); i++) {
                 BlockAnnotation const &block(anno.blocks[i]);
                 qreal polyOpacity = i == listSelectedBlock ? 1.0 : 0.6;
-                qreal charBgOpacity = i == listSelectedBlock ? 0.3 : 0.07;
-                qreal charOpacity = i == listSelectedBlock ? 1.0 : 1.0;
 
                 // 绘制辅助图层
                 painter.setOpacity(polyOpacity);
@@ -199,21 +201,8 @@ void ImageViewer::paintEvent(QPaintEvent *event) {
                 painter.setBrush(Qt::NoBrush);
                 foreach (QPolygonF const &poly, block.getPendingCharacterPoly())
                     painter.drawPolygon(toScreenPoly(poly));
-
-                // 绘制已标注的字符区域
-                foreach (CharacterAnnotation const &charAnno, block.getCharacterAnnotation()) {
-                    QString text = charAnno.text;
-                    QColor penColor = Qt::green;
-                    qreal penWidth = 1.0;
-                    if (0 != charAnno.props.value("mask", 0)) {
-                        penColor = Qt::red;
-                        penWidth = 2.0;
-                        text = " ";
-                        charBgOpacity = i == listSelectedBlock ? 0.3 : 0;
-                    }
-                    paintCharacter(charAnno.box, text, polyOpacity, charBgOpacity, charOpacity, penColor, Qt::yellow, Qt::black, penWidth);
-                }
             }
+        }
 
         // 绘制用户关注的焦点（上一次鼠标点击位置）
         if (!controlPressed || !shiftPressed) {
@@ -245,14 +234,16 @@ void ImageViewer::paintEvent(QPaintEvent *event) {
         statusLabel->setText(anno.getTips());
     } else if (radioButtonProp->isChecked()) {
         // 绘制图片
-        if (!scaledImage.isNull())
-            painter.drawImage(imageLeftTop, scaledImage);
+        imagePyramid->paint(painter, imageLeftTop, scaleFactor, event->rect());
+
+        if (!controlPressed || !shiftPressed) {
+            // 已标注的字符区域画在缓存图层里，这里只贴图
+            updateAnnotationLayer(-1);
+            painter.drawImage(QPoint(0, 0), annotationLayer);
 
-        if (!controlPressed || !shiftPressed)
             for (int i = 0; i < anno.blocks.size(); i++) {
                 BlockAnnotation const &block(anno.blocks[i]);
                 qreal polyOpacity = 0.8;
-                qreal bgOpacity = 0.15;
 
                 // 绘制辅助图层
                 painter.setOpacity(polyOpacity);
@@ -267,29 +258,8 @@ void ImageViewer::paintEvent(QPaintEvent *event) {
                 painter.setBrush(Qt::NoBrush);
                 foreach (QPolygonF const &poly, block.getPendingCharacterPoly())
                     painter.drawPolygon(toScreenPoly(poly));
-
-                // 绘制已标注的字符区域
-                for (int j = 0; j < block.characters.size(); j++) {
-                    CharacterAnnotation const &charAnno(block.characters[j]);
-                    QColor aroundColor(0 == charAnno.props.value("mask", 0) ?
-                                           0 == charAnno.props.value("pass", 0) ? Qt::green : Qt::blue : Qt::red);
-                    if (i == selectedBlockIndex && (-1 == selectedCharIndex || j == selectedCharIndex)) {
-                        painter.setOpacity(bgOpacity);
-                        painter.setPen(Qt::NoPen);
-                        painter.setBrush(Qt::yellow);
-                        painter.drawPolygon(toScreenPoly(charAnno.box));
-                        painter.setOpacity(polyOpacity);
-                        painter.setPen(QPen(aroundColor, 2.0));
-                        painter.setBrush(Qt::NoBrush);
-                        painter.drawPolygon(toScreenPoly(charAnno.box));
-                    } else {
-                        painter.setOpacity(polyOpacity);
-                        painter.setPen(QPen(aroundColor, 1.0));
-                        painter.setBrush(Qt::NoBrush);
-                        painter.drawPolygon(toScreenPoly(charAnno.box));
-                    }
-                }
             }
+        }
         statusLabel->setText(QString(""));
     } else if (radioButtonInsp->isChecked()) {
         int xy_char = horizontalSliderInsp->value();
@@ -340,19 +310,16 @@ void ImageViewer::paintEvent(QPaintEvent *event) {
                         h = w;
                     }
                     QRect bound(round(x), round(y), round(w), round(h));
-                    QImage cropped(image.copy(bound));
-                    QImage resized = cropped.scaled(QSize(xy_char, xy_char),
-                                                    Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
                     int x_start = x_off + x_top * (xy_char + xy_gap);
                     int y_start = y_off + y_top * (xy_char + xy_gap);
-                    painter.drawImage(x_start, y_start, resized);
-                    QPolygonF poly;
-                    foreach (QPointF const &p, ch.box)
-                        poly.append(QPointF((p.x() - x) / bound.width() * xy_char + x_start,
-                                            (p.y() - y) / bound.width() * xy_char + y_start));
+                    // 不在窗口内的格子不取缩略图
+                    if (y_start + xy_char >= 0 && y_start < height())
+                        painter.drawImage(x_start, y_start, thumbnailCache->thumbnail(qMakePair(i, j), bound, xy_char));
+                    qreal zoom = (qreal)xy_char / bound.width();
+                    Quad poly(Quad(ch.box).transformed(zoom, QPointF(x_start - x * zoom, y_start - y * zoom)));
                     painter.setPen(Qt::green);
                     painter.setBrush(Qt::NoBrush);
-                    painter.drawPolygon(poly);
+                    painter.drawPolygon(poly.points(), 4);
                     if (i == selectedBlockIndex && (-1 == selectedCharIndex || j == selectedCharIndex)) {
                         painter.setPen(QPen(Qt::red, 3));
                         painter.setBrush(Qt::NoBrush);
@@ -368,6 +335,7 @@ void ImageViewer::paintEvent(QPaintEvent *event) {
             });
         };
 
+        QVector<CharacterProps::Id> groupPropIds;
         for (int i = 0; i < radioIdx2propname.size() - 1; i++) {
             QString prop_str(radioIdx2propname[i]);
             QMap<QString, QString> trans({{"covered", "遮挡"},
@@ -378,30 +346,31 @@ void ImageViewer::paintEvent(QPaintEvent *event) {
                                           {"handwritten", "手写"},
                                          });
             QString translated = trans.contains(prop_str) ? trans[prop_str] : prop_str;
+            CharacterProps::Id propId = propIdOf(prop_str);
+            groupPropIds.append(propId);
             addGroup([&](CharacterAnnotation const &ch) {
-                return 1 == ch.props.value(prop_str, 0) && 0 == ch.props.value("mask", 0) && ch.text != "*";
+                return 1 == ch.props.value(propId) && 0 == ch.props.value(CharacterProps::MASK) && ch.text != "*";
             }, translated);
         }
         addGroup([&](CharacterAnnotation const &ch) {
-            if (1 == ch.props.value("mask", 0) || ch.text == "*" || 0 == ch.props.value("pass", 0))
+            if (1 == ch.props.value(CharacterProps::MASK) || ch.text == "*" || 0 == ch.props.value(CharacterProps::PASS))
                 return false;
-            for (int i = 0; i < radioIdx2propname.size() - 1; i++) {
-                QString prop_str(radioIdx2propname[i]);
-                if (1 == ch.props.value(prop_str, 0))
+            foreach (CharacterProps::Id propId, groupPropIds)
+                if (1 == ch.props.value(propId))
                     return false;
-            }
             return true;
         }, "不包含上述属性");
         addGroup([&](CharacterAnnotation const &ch) {
             return ch.text == "*";
         }, "*");
         addGroup([&](CharacterAnnotation const &ch) {
-            return 0 == ch.props.value("pass", 0) && 0 == ch.props.value("mask", 0) && ch.text != "*";
+            return 0 == ch.props.value(CharacterProps::PASS) && 0 == ch.props.value(CharacterProps::MASK) && ch.text != "*";
         }, "未标注属性");
         addGroup([&](CharacterAnnotation const &) {
             return false;
         }, "(底部)");
         respDisplayYMaxOff = qMax(0, y_off_base + (y_top + 2) * (xy_char + xy_gap) - height());
+        thumbnailCache->generatePending();
     }
 
     painter.end();
@@ -420,7 +389,7 @@ void ImageViewer::keyPressEvent(QKeyEvent *event) {
         shiftPressed = true;
         updatePendingAnnotation();
     } else if (event->key() == Qt::Key_Left || event->key() == Qt::Key_Right) {
-        int current = imagesInFolder.indexOf(QFileInfo(imageFileName).fileName());
+        int current = currentImageIndex();
         if (event->key() == Qt::Key_Left) {
             if (current > 0)
                 loadFile(imageFolder.filePath(imagesInFolder[current - 1]));
@@ -506,29 +475,33 @@ void ImageViewer::mousePressEvent(QMouseEvent *event) {
         QPointF p(toImageUV(event->pos()));
         selectedBlockIndex = selectedCharIndex = -1;
         qreal mindist = 0;
-        for (int i = 0; i < anno.blocks.size(); i++) {
-            BlockAnnotation const &blockAnno(anno.blocks[i]);
-            for (int j = 0; j < blockAnno.characters.size(); j++) {
-                CharacterAnnotation const &charAnno(blockAnno.characters[j]);
-                if (charAnno.box.containsPoint(p, Qt::OddEvenFill)) {
-                    qreal dist = (p - charAnno.box.boundingRect().center()).manhattanLength();
-                    if (-1 == selectedBlockIndex || dist < mindist) {
-                        selectedBlockIndex = i;
-                        if (!wholeBlock)
-                            selectedCharIndex = j;
-                        mindist = dist;
-                    }
+        foreach (CharacterIndex::Key const &key, characterIndex().query(p)) {
+            int i = key.first, j = key.second;
+            CharacterAnnotation const &charAnno(anno.blocks[i].characters[j]);
+            Quad box(charAnno.box);
+            if (box.containsPoint(p)) {
+                qreal dist = (p - box.boundingRect().center()).manhattanLength();
+                if (-1 == selectedBlockIndex || dist < mindist) {
+                    selectedBlockIndex = i;
+                    if (!wholeBlock)
+                        selectedCharIndex = j;
+                    mindist = dist;
                 }
             }
         }
     };
     auto inspSelectBlock = [&](bool wholeBlock) {
         selectedBlockIndex = selectedCharIndex = -1;
-        for (QPair<QRect, QPoint> const &p: respRegions) {
-            if (p.first.contains(event->pos(), false)) {
-                selectedBlockIndex = p.second.x();
+        // respRegions 按行排列，纵坐标单调不减，二分找到第一个可能包含该点的格子
+        int y = event->pos().y();
+        QVector<QPair<QRect, QPoint> >::const_iterator it = std::lower_bound(
+                    respRegions.constBegin(), respRegions.constEnd(), y,
+                    [](QPair<QRect, QPoint> const &region, int y) { return region.first.bottom() < y; });
+        for (; it != respRegions.constEnd() && it->first.top() <= y; ++it) {
+            if (it->first.contains(event->pos(), false)) {
+                selectedBlockIndex = it->second.x();
                 if (!wholeBlock)
-                    selectedCharIndex = p.second.y();
+                    selectedCharIndex = it->second.y();
                 break;
             }
         }
@@ -544,6 +517,7 @@ void ImageViewer::mousePressEvent(QMouseEvent *event) {
             } else {
                 drawingLabel = true;
                 anno.onStartPoint(toImageUV(event->pos()), scaleFactor, shiftPressed);
+                annotationChanged();
                 update();
             }
         }
@@ -643,6 +617,7 @@ void ImageViewer::dropEvent(QDropEvent *event){
 
 void ImageViewer::closeEvent(QCloseEvent *event) {
     save();
+    annotationWriter->flush();
     QMainWindow::closeEvent(event);
 }
 
@@ -714,7 +689,9 @@ void ImageViewer::createMenus() {
 }
 
 void ImageViewer::loadFile(QString const &fileName) {
-    QImage newImage(fileName);
+    ImagePrefetcher::Entry prefetched;
+    bool isPrefetched = prefetcher.take(fileName, prefetched);
+    QImage newImage(isPrefetched ? prefetched.image : QImage(fileName));
     if (newImage.isNull()) {
         QMessageBox::information(this, tr("Image Viewer"),
                                  tr("Cannot load %1.").arg(fileName));
@@ -730,36 +707,46 @@ void ImageViewer::loadFile(QString const &fileName) {
     QDir dir_new(imageFileName);
     dir_new.cdUp();
     if (fileNameOld.isEmpty() || flag_old == false || dir_old.absolutePath() != dir_new.absolutePath()) {
+        // 大文件夹的列举放到后台，先显示当前图片
         imageFolder = dir_new;
-        QStringList filters;
-        filters << "*.jpg" << "*.png" << "*.bmp" << "*.jpeg" << "*.gif";
-        imagesInFolder = dir_new.entryList(filters, QDir::Files | QDir::Readable);
+        imagesInFolder.clear();
+        imageIndexInFolder.clear();
+        folderIndexing = true;
+        folderIndexWatcher.setFuture(QtConcurrent::run(&ImageViewer::indexFolder, dir_new));
+        prefetcher.clear();
     }
 
-    setWindowTitle(tr("[第%1/%2张] %3").arg(1 + imagesInFolder.indexOf(QFileInfo(imageFileName).fileName())).
-                   arg(imagesInFolder.size()).arg(QFileInfo(imageFileName).fileName()));
+    updateWindowTitle();
     image = newImage;
+    imagePyramid->build(image);
+    thumbnailCache->setImage(image);
     resetLocation();
-    updateScaledImage();
     resetHistory();
     selectedBlockIndex = selectedCharIndex = -1;
-    QFile file(annotationFileName(imageFileName));
-    if (file.open(QIODevice::ReadOnly)) {
-        QDataStream stream(&file);
-        stream >> anno;
-        bool okAnno = stream.status() == QDataStream::Ok;
-        QByteArray array;
-        stream >> array;
-        array = qUncompress(array);
-        QDataStream st2(&array, QIODevice::ReadOnly);
-        st2 >> history;
-        bool okHistory = stream.status() == QDataStream::Ok && st2.status() == QDataStream::Ok;
-        file.close();
-        if (!okHistory) {
-            file.copy(file.fileName() + ".bak");
+    QString annoFileName(annotationFileName(imageFileName));
+    AnnotationFile::Status status;
+    if (isPrefetched) {
+        status = prefetched.status;
+        if (status != AnnotationFile::NotFound) {
+            anno = prefetched.anno;
+            history = prefetched.history;
+        }
+    } else {
+        ImageAnnotation loadedAnno;
+        AnnotationHistory loadedHistory;
+        annotationWriter->waitFor(annoFileName);
+        status = AnnotationFile::read(annoFileName, loadedAnno, loadedHistory);
+        if (status != AnnotationFile::NotFound) {
+            anno = loadedAnno;
+            history = loadedHistory;
+        }
+    }
+    if (status != AnnotationFile::NotFound) {
+        if (status != AnnotationFile::Ok) {
+            QFile::copy(annoFileName, annoFileName + ".bak");
             QMessageBox::information(this, tr("Image Viewer"),
-                                     tr("File is corrupted, data will be cleared: %1").arg(file.fileName()));
-            if (!okAnno) {
+                                     tr("File is corrupted, data will be cleared: %1").arg(annoFileName));
+            if (status == AnnotationFile::CorruptedAnnotation) {
                 resetHistory();
             }
             ImageAnnotation loadedAnno = anno;
@@ -767,46 +754,124 @@ void ImageViewer::loadFile(QString const &fileName) {
             anno = loadedAnno;
             addHistoryPoint();
         }
+        annotationChanged();
         historyMergeKey = "";
         respDisplayYMaxOff = 0;
         respDisplayYOff = 0;
     }
+    prefetchNeighbours();
     update();
+    // 历史记录在后台解码，在此之前撤销或修改标注时再等待
+    if (!history.isDecoded())
+        historyWatcher.setFuture(QtConcurrent::run(&ImageViewer::decodeHistory, history));
 }
 
-void ImageViewer::updateScaledImage() {
-    if (image.isNull()) {
-        scaledImage = image.copy();
+ImageViewer::FolderIndex ImageViewer::indexFolder(QDir dir) {
+    FolderIndex index;
+    index.folder = dir.absolutePath();
+    QStringList filters;
+    filters << "*.jpg" << "*.png" << "*.bmp" << "*.jpeg" << "*.gif";
+    index.images = dir.entryList(filters, QDir::Files | QDir::Readable);
+    index.positions.reserve(index.images.size());
+    for (int i = 0; i < index.images.size(); i++)
+        index.positions.insert(index.images[i], i);
+    return index;
+}
+
+void ImageViewer::onFolderIndexed() {
+    FolderIndex index = folderIndexWatcher.result();
+    if (index.folder != imageFolder.absolutePath())
         return;
+    imagesInFolder = index.images;
+    imageIndexInFolder = index.positions;
+    folderIndexing = false;
+    updateWindowTitle();
+    prefetchNeighbours();
+}
+
+int ImageViewer::currentImageIndex() const {
+    return imageIndexInFolder.value(QFileInfo(imageFileName).fileName(), -1);
+}
+
+void ImageViewer::updateWindowTitle() {
+    QString name = QFileInfo(imageFileName).fileName();
+    if (folderIndexing)
+        setWindowTitle(tr("[第?/?张] %1").arg(name));
+    else
+        setWindowTitle(tr("[第%1/%2张] %3").arg(1 + currentImageIndex()).arg(imagesInFolder.size()).arg(name));
+}
+
+void ImageViewer::prefetchNeighbours() {
+    int current = currentImageIndex();
+    QStringList imageFiles, annotationFiles;
+    if (current >= 0) {
+        // 向后翻页更常见，优先预读下一张
+        for (int d = 1; d <= prefetchRadius; d++) {
+            int neighbours[2] = {current + d, current - d};
+            for (int i: neighbours) {
+                if (0 <= i && i < imagesInFolder.size()) {
+                    imageFiles.append(imageFolder.filePath(imagesInFolder[i]));
+                    annotationFiles.append(annotationFileName(imageFiles.last()));
+                }
+            }
+        }
     }
-    scaledImage = image.scaled(QSize(image.width() * scaleFactor, image.height() * scaleFactor),
-                               Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    prefetcher.prefetch(imageFiles, annotationFiles);
 }
 
 void ImageViewer::resetHistory() {
-    redoHistory.clear();
     history.clear();
     anno = ImageAnnotation();
     anno.onNewBlock();
+    annotationChanged();
     updateBlockList();
-    history.push_back(anno);
+    history.push(anno);
     keepHistoryOnUndo = false;
 }
 
+QPair<bool, AnnotationHistory> ImageViewer::decodeHistory(AnnotationHistory history) {
+    bool ok = history.decode();
+    return qMakePair(ok, history);
+}
+
+void ImageViewer::ensureHistoryDecoded() {
+    if (history.isDecoded())
+        return;
+    historyWatcher.waitForFinished();
+    QPair<bool, AnnotationHistory> result;
+    if (historyWatcher.future().resultCount() > 0)
+        result = historyWatcher.result();
+    // 后台解码的不是当前这份数据时就地解码
+    if (!result.first || !result.second.isSameAs(history))
+        result = decodeHistory(history);
+    history = result.second;
+    if (!result.first) {
+        QString annoFileName(annotationFileName(imageFileName));
+        QFile::copy(annoFileName, annoFileName + ".bak");
+        QMessageBox::information(this, tr("Image Viewer"),
+                                 tr("File is corrupted, data will be cleared: %1").arg(annoFileName));
+    }
+}
+
+void ImageViewer::onHistoryDecoded() {
+    ensureHistoryDecoded();
+}
+
 void ImageViewer::addHistoryPoint(int flag) {
+    ensureHistoryDecoded();
+    annotationChanged();
     historyMergeKey = "";
     if (flag == 1) {
         keepHistoryOnUndo = true;
         return;
     } else if (flag == 2) {
-        if (!history.isEmpty())
-            history.pop_back();
         keepHistoryOnUndo = false;
+        history.replaceLast(anno);
+        return;
     } else { // flag == 0
         keepHistoryOnUndo = false;
     }
-    redoHistory.clear();
-    history.append(anno);
+    history.push(anno);
 }
 
 void ImageViewer::addHistoryPoint(QString const &mergeKey) {
@@ -821,29 +886,29 @@ void ImageViewer::addHistoryPoint(QString const &mergeKey) {
 void ImageViewer::changePropStatus(int index, bool checked) {
     if (index < 0 || radioIdx2propname.size() <= index)
         return;
-    QString const &propname(radioIdx2propname[index]);
+    CharacterProps::Id propId = propIdOf(radioIdx2propname[index]);
     if (selectedBlockIndex < 0 || anno.blocks.size() <= selectedBlockIndex)
         return;
     BlockAnnotation &blockAnno(anno.blocks[selectedBlockIndex]);
     if (selectedCharIndex == -1) {
         for (CharacterAnnotation &charAnno: blockAnno.characters) {
             if (checked)
-                charAnno.props.insert(propname, 1);
+                charAnno.props.insert(propId, 1);
             else
-                charAnno.props.remove(propname);
-            if (propname != "pass")
-                charAnno.props.insert("pass", 1);
+                charAnno.props.remove(propId);
+            if (propId != CharacterProps::PASS)
+                charAnno.props.insert(CharacterProps::PASS, 1);
         }
     } else {
         if (selectedCharIndex < 0 || blockAnno.characters.size() <= selectedCharIndex)
             return;
         CharacterAnnotation &charAnno(blockAnno.characters[selectedCharIndex]);
         if (checked)
-            charAnno.props.insert(propname, 1);
+            charAnno.props.insert(propId, 1);
         else
-            charAnno.props.remove(propname);
-        if (propname != "pass")
-            charAnno.props.insert("pass", 1);
+            charAnno.props.remove(propId);
+        if (propId != CharacterProps::PASS)
+            charAnno.props.insert(CharacterProps::PASS, 1);
     }
     addHistoryPoint(QString("changePropStatus::propblk=%1").arg(selectedBlockIndex));
     update();
@@ -858,10 +923,10 @@ void ImageViewer::updatePropsCheckBox() {
     if (selectedCharIndex == -1) {
         for (int i = 0; i < radioIdx2propname.size(); i++) {
             if (i < (int)(sizeof(checkBoxProps) / sizeof(*checkBoxProps))) {
-                QString const &propname(radioIdx2propname[i]);
+                CharacterProps::Id propId = propIdOf(radioIdx2propname[i]);
                 bool has0 = false, has1 = false;
                 for (CharacterAnnotation const &charAnno: blockAnno.characters) {
-                    if (0 == charAnno.props.value(propname, 0))
+                    if (0 == charAnno.props.value(propId))
                         has0 = true;
                     else
                         has1 = true;
@@ -880,8 +945,8 @@ void ImageViewer::updatePropsCheckBox() {
         CharacterAnnotation const &charAnno(blockAnno.characters[selectedCharIndex]);
         for (int i = 0; i < radioIdx2propname.size(); i++) {
             if (i < (int)(sizeof(checkBoxProps) / sizeof(*checkBoxProps))) {
-                QString const &propname(radioIdx2propname[i]);
-                if (0 != charAnno.props.value(propname, 0))
+                CharacterProps::Id propId = propIdOf(radioIdx2propname[i]);
+                if (0 != charAnno.props.value(propId))
                     checkBoxProps[i]->setCheckState(Qt::Checked);
             }
         }
@@ -906,10 +971,10 @@ void ImageViewer::updateBlockList() {
                 text += tr("-");
             else
                 text += charAnno.text;
-            if (0 == charAnno.props.value("pass", 0))
+            if (0 == charAnno.props.value(CharacterProps::PASS))
                 hasProps = false;
         }
-        if (block.characters.size() > 0 && 0 != block.characters.first().props.value("mask", 0)) {
+        if (block.characters.size() > 0 && 0 != block.characters.first().props.value(CharacterProps::MASK)) {
             text = tr("<mask>");
         } else if (text.isEmpty()) {
             text = tr("<empty>");
@@ -926,6 +991,153 @@ void ImageViewer::updateBlockList() {
     radioButtonProp->setText(propsFinished ? tr("属性（已全部标注）") : tr("属性"));
 }
 
+void ImageViewer::annotationChanged() {
+    charIndex.invalidate();
+    annotationLayerDirty = true;
+}
+
+void ImageViewer::updateAnnotationLayer(int listSelectedBlock) {
+    AnnotationLayerState state;
+    state.leftTop = imageLeftTop;
+    state.scaleFactor = scaleFactor;
+    state.size = size();
+    state.propMode = radioButtonProp->isChecked();
+    state.listSelectedBlock = listSelectedBlock;
+    state.selectedBlockIndex = selectedBlockIndex;
+    state.selectedCharIndex = selectedCharIndex;
+    if (!annotationLayerDirty && state == annotationLayerState)
+        return;
+    annotationLayerDirty = false;
+    annotationLayerState = state;
+    if (size().isEmpty())
+        return;
+
+    int dpr = devicePixelRatio();
+    if (annotationLayer.size() != size() * dpr) {
+        annotationLayer = QImage(size() * dpr, QImage::Format_ARGB32_Premultiplied);
+        annotationLayer.setDevicePixelRatio(dpr);
+    }
+    annotationLayer.fill(Qt::transparent);
+    QPainter painter(&annotationLayer);
+
+    auto paintCharacter = [&](QPolygonF const &box, QString const &text, qreal polyOpacity, qreal charBgOpacity, qreal charOpacity,
+            QColor penColor, QColor brushColor, QColor charColor, qreal penWidth) {
+        Quad polyScreen = toScreenQuad(Quad(box));
+        QRectF bounding = polyScreen.boundingRect();
+
+        // 字符包围盒
+        painter.setOpacity(polyOpacity);
+        painter.setPen(QPen(penColor, penWidth));
+        painter.setBrush(Qt::NoBrush);
+        painter.drawPolygon(polyScreen.points(), 4);
+
+        // 打印文字
+        if (!text.isEmpty() && qMin(bounding.width(), bounding.height()) >= lodOutlineOnlySize) {
+            painter.setOpacity(charBgOpacity);
+            painter.setPen(Qt::NoPen);
+            painter.setBrush(brushColor);
+            painter.drawPolygon(polyScreen.points(), 4);
+
+            painter.setOpacity(charOpacity);
+            painter.setPen(QPen(charColor));
+            painter.setBrush(Qt::NoBrush);
+            int fontSize = (int)qMax(qMin(bounding.width() / text.length(), bounding.height()) * 0.67, 5.0);
+            Glyph const &glyph(cachedGlyph(text, fontSize));
+            QSizeF glyphSize(glyph.staticText.size());
+            painter.setFont(glyph.font);
+            painter.drawStaticText(bounding.center() - QPointF(glyphSize.width() / 2, glyphSize.height() / 2), glyph.staticText);
+        }
+    };
+
+    QVector<CharacterIndex::Key> visible = visibleCharacters(rect());
+    int k = 0;
+    for (int i = 0; i < anno.blocks.size(); i++) {
+        BlockAnnotation const &block(anno.blocks[i]);
+        if (!state.propMode) {
+            qreal polyOpacity = i == listSelectedBlock ? 1.0 : 0.6;
+            qreal charBgOpacity = i == listSelectedBlock ? 0.3 : 0.07;
+            qreal charOpacity = i == listSelectedBlock ? 1.0 : 1.0;
+
+            // 绘制视口内已标注的字符区域
+            for (; k < visible.size() && visible[k].first == i; k++) {
+                if (visible[k].second >= block.characters.size())
+                    continue;
+                CharacterAnnotation const &charAnno(block.characters[visible[k].second]);
+                QString text = charAnno.text;
+                QColor penColor = Qt::green;
+                qreal penWidth = 1.0;
+                if (0 != charAnno.props.value(CharacterProps::MASK)) {
+                    penColor = Qt::red;
+                    penWidth = 2.0;
+                    text = " ";
+                    charBgOpacity = i == listSelectedBlock ? 0.3 : 0;
+                }
+                paintCharacter(charAnno.box, text, polyOpacity, charBgOpacity, charOpacity, penColor, Qt::yellow, Qt::black, penWidth);
+            }
+        } else {
+            qreal polyOpacity = 0.8;
+            qreal bgOpacity = 0.15;
+
+            // 绘制视口内已标注的字符区域
+            for (; k < visible.size() && visible[k].first == i; k++) {
+                int j = visible[k].second;
+                if (j >= block.characters.size())
+                    continue;
+                CharacterAnnotation const &charAnno(block.characters[j]);
+                QColor aroundColor(0 == charAnno.props.value(CharacterProps::MASK) ?
+                                       0 == charAnno.props.value(CharacterProps::PASS) ? Qt::green : Qt::blue : Qt::red);
+                if (i == selectedBlockIndex && (-1 == selectedCharIndex || j == selectedCharIndex)) {
+                    Quad polyScreen = toScreenQuad(Quad(charAnno.box));
+                    QRectF bounding = polyScreen.boundingRect();
+                    if (qMin(bounding.width(), bounding.height()) >= lodOutlineOnlySize) {
+                        painter.setOpacity(bgOpacity);
+                        painter.setPen(Qt::NoPen);
+                        painter.setBrush(Qt::yellow);
+                        painter.drawPolygon(polyScreen.points(), 4);
+                    }
+                    painter.setOpacity(polyOpacity);
+                    painter.setPen(QPen(aroundColor, 2.0));
+                    painter.setBrush(Qt::NoBrush);
+                    painter.drawPolygon(polyScreen.points(), 4);
+                } else {
+                    painter.setOpacity(polyOpacity);
+                    painter.setPen(QPen(aroundColor, 1.0));
+                    painter.setBrush(Qt::NoBrush);
+                    painter.drawPolygon(toScreenQuad(Quad(charAnno.box)).points(), 4);
+                }
+            }
+        }
+    }
+}
+
+ImageViewer::Glyph const &ImageViewer::cachedGlyph(QString const &text, int fontSize) {
+    QPair<QString, int> key(text, fontSize);
+    QHash<QPair<QString, int>, Glyph>::const_iterator it = glyphCache.constFind(key);
+    if (it != glyphCache.constEnd())
+        return it.value();
+    if (glyphCache.size() >= maxGlyphCacheSize)
+        glyphCache.clear();
+    Glyph glyph;
+    glyph.font = QFont("Arial", fontSize, QFont::Bold);
+    glyph.staticText.setText(text);
+    glyph.staticText.setTextFormat(Qt::PlainText);
+    glyph.staticText.setPerformanceHint(QStaticText::AggressiveCaching);
+    glyph.staticText.prepare(QTransform(), glyph.font);
+    return glyphCache.insert(key, glyph).value();
+}
+
+CharacterIndex const &ImageViewer::characterIndex() {
+    if (!charIndex.isValid())
+        charIndex.sync(anno);
+    return charIndex;
+}
+
+QVector<CharacterIndex::Key> ImageViewer::visibleCharacters(QRect const &screenRect) {
+    QRectF rect(toImageUV(screenRect.topLeft()), toImageUV(screenRect.bottomRight() + QPoint(1, 1)));
+    qreal margin = 3.0 / scaleFactor; // 留出画笔宽度
+    return characterIndex().query(rect.adjusted(-margin, -margin, margin, margin));
+}
+
 QPointF ImageViewer::toImageUV(QPoint screenUV) const {
     QPoint delta = screenUV - imageLeftTop;
     return QPointF(delta.x() / scaleFactor, delta.y() / scaleFactor);
@@ -936,6 +1148,13 @@ QPointF ImageViewer::toScreenUV(QPointF imageUV) const {
     return imageLeftTop + delta;
 }
 
+Quad ImageViewer::toScreenQuad(Quad const &quad) const {
+    Quad res;
+    for (int i = 0; i < 4; i++)
+        res[i] = toScreenUV(quad[i]);
+    return res;
+}
+
 QPolygonF ImageViewer::toScreenPoly(QPolygonF const &poly) const {
     QPolygonF res;
     foreach (QPointF const &p, poly)
@@ -965,6 +1184,7 @@ void ImageViewer::inputStringToAnnotation(int index) {
                                              QLineEdit::Normal, originText, &ok);
         if (ok) {
             QString inputRes = anno.onInputString(text, index);
+            annotationChanged();
             update();
             if (!inputRes.isEmpty()) {
                 QMessageBox::information(this, tr("Image Viewer"), inputRes);
@@ -1022,47 +1242,25 @@ void ImageViewer::open() {
 void ImageViewer::save() {
     if (imageFileName.isEmpty())
         return;
-    QFile file0(annotationFileName(imageFileName));
-    QFile file1(annotationFileName(imageFileName) + ".tmp");
-    if (file1.exists()) {
-        QMessageBox::information(this, tr("Image Viewer"),
-                                 tr("Already exists %1.").arg(file1.fileName()));
-        return;
-    }
-    if (!file1.open(QIODevice::WriteOnly)) {
-        QMessageBox::information(this, tr("Image Viewer"),
-                                 tr("Cannot write %1.").arg(file1.fileName()));
-        return;
-    }
-    QDataStream stream(&file1);
-    stream << anno;
-    QByteArray array;
-    QDataStream st2(&array, QIODevice::WriteOnly);
-    st2 << history;
-    stream << qCompress(array);
-    file1.close();
-    file0.remove();
-    if (!file1.rename(file0.fileName())) {
-        QMessageBox::information(this, tr("Image Viewer"),
-                                 tr("Cannot rename %1.").arg(file0.fileName()));
-        return;
-    }
+    // 压缩和写文件都在后台进行，这里只提交快照
+    annotationWriter->write(annotationFileName(imageFileName), anno, history);
 }
 
 void ImageViewer::undo() {
     if (drawingLabel)
         return;
+    ensureHistoryDecoded();
     if (keepHistoryOnUndo) {
-        anno = history.back();
+        anno = history.current();
         keepHistoryOnUndo = false;
+        annotationChanged();
         update();
         return;
     }
-    if (history.size() <= 1)
+    if (!history.canUndo())
         return;
-    redoHistory.push_back(history.back());
-    history.pop_back();
-    anno = history.back();
+    anno = history.undo();
+    annotationChanged();
     updatePendingAnnotation();
     update();
 }
@@ -1070,11 +1268,11 @@ void ImageViewer::undo() {
 void ImageViewer::redo() {
     if (drawingLabel)
         return;
-    if (redoHistory.empty())
+    ensureHistoryDecoded();
+    if (!history.canRedo())
         return;
-    history.push_back(redoHistory.back());
-    redoHistory.pop_back();
-    anno = history.back();
+    anno = history.redo();
+    annotationChanged();
     updatePendingAnnotation();
     update();
 }
@@ -1105,7 +1303,6 @@ void ImageViewer::zoomIn() {
     qreal oldFactor = scaleFactor;
     scaleFactor /= 0.8;
     imageLeftTop = (imageLeftTop - mousePos) / oldFactor * scaleFactor + mousePos;
-    updateScaledImage();
     update();
 }
 
@@ -1116,7 +1313,6 @@ void ImageViewer::zoomOut() {
     qreal oldFactor = scaleFactor;
     scaleFactor *= 0.8;
     imageLeftTop = (imageLeftTop - mousePos) / oldFactor * scaleFactor + mousePos;
-    updateScaledImage();
     update();
 }
 
@@ -1134,12 +1330,12 @@ void ImageViewer::resetLocation(QSize size) {
     int h = size.height() - menuBar()->height();
     if (image.isNull()) {
         scaleFactor = 1;
-        updateScaledImage();
         setLocation(QPoint(0, 0));
     } else {
         scaleFactor = qMin((qreal)w / image.width(), (qreal)h / image.height());
-        updateScaledImage();
-        setLocation(QPoint((w - scaledImage.width()) / 2, menuBar()->height() + (h - scaledImage.height()) / 2));
+        int scaledWidth = image.width() * scaleFactor;
+        int scaledHeight = image.height() * scaleFactor;
+        setLocation(QPoint((w - scaledWidth) / 2, menuBar()->height() + (h - scaledHeight) / 2));
     }
     update();
 }
@@ -1158,6 +1354,13 @@ void ImageViewer::onListWidgetDoubleClicked(QModelIndex index) {
     }
 }
 
+void ImageViewer::onWriteFailed(QString message) {
+    QMessageBox *box = new QMessageBox(QMessageBox::Warning, tr("Image Viewer"), message, QMessageBox::Ok, this);
+    box->setAttribute(Qt::WA_DeleteOnClose);
+    box->setModal(false);
+    box->show();
+}
+
 
 /// PropCheckReciever
 
@@ -5,7 +5,16 @@
 #include <QListWidget>
 #include <QDir>
 #include <QJsonObject>
+#include <QStaticText>
+#include <QHash>
+#include <QFutureWatcher>
 #include "imageannotation.h"
+#include "annotationhistory.h"
+#include "imagepyramid.h"
+#include "thumbnailcache.h"
+#include "characterindex.h"
+#include "imageprefetcher.h"
+#include "annotationwriter.h"
 
 QT_BEGIN_NAMESPACE
 class QAction;
@@ -43,16 +52,37 @@ private:
     void createActions();
     void createMenus();
     void loadFile(QString const &fileName);
-    void updateScaledImage();
+    void prefetchNeighbours();
+    int currentImageIndex() const;
+    void updateWindowTitle();
+
+    struct FolderIndex {
+        QString folder;
+        QStringList images;
+        QHash<QString, int> positions; // 文件名 -> 在 images 中的下标
+    };
+    static FolderIndex indexFolder(QDir dir);
     void resetLocation(QSize size);
     void resetHistory();
+    static QPair<bool, AnnotationHistory> decodeHistory(AnnotationHistory history);
+    void ensureHistoryDecoded();
     void addHistoryPoint(int flag = 0); // 0: strong history; 1: week history; 2: replace last history
     void addHistoryPoint(QString const &mergeKey);
     void changePropStatus(int index, bool checked);
     void updatePropsCheckBox();
     void updateBlockList();
+    void annotationChanged();
+    void updateAnnotationLayer(int listSelectedBlock);
+    struct Glyph {
+        QFont font;
+        QStaticText staticText;
+    };
+    Glyph const &cachedGlyph(QString const &text, int fontSize);
+    CharacterIndex const &characterIndex();
+    QVector<CharacterIndex::Key> visibleCharacters(QRect const &screenRect);
     QPointF toImageUV(QPoint screenUV) const;
     QPointF toScreenUV(QPointF imageUV) const;
+    Quad toScreenQuad(Quad const &quad) const;
     QPolygonF toScreenPoly(QPolygonF const &poly) const;
     void updatePendingAnnotation();
     void inputStringToAnnotation(int index);
@@ -78,6 +108,9 @@ private slots:
     void resetLocation();
     void onListWidgetSelect();
     void onListWidgetDoubleClicked(QModelIndex index);
+    void onWriteFailed(QString message);
+    void onFolderIndexed();
+    void onHistoryDecoded();
 
 private:
     QAction *openAct;
@@ -114,16 +147,43 @@ private:
     QString annotationSuffix;
     QDir imageFolder;
     QStringList imagesInFolder;
+    QHash<QString, int> imageIndexInFolder;
+    bool folderIndexing;
+    QFutureWatcher<FolderIndex> folderIndexWatcher;
     QString imageFileName;
     QString imageBaseName;
     QImage image;
-    QImage scaledImage;
+    ImagePyramid *imagePyramid;
+    ThumbnailCache *thumbnailCache;
+    ImagePrefetcher prefetcher;
+    AnnotationWriter *annotationWriter;
     QPoint imageLeftTop;
     qreal scaleFactor;
 
     ImageAnnotation anno;
-    QVector<ImageAnnotation> history;
-    QVector<ImageAnnotation> redoHistory;
+    CharacterIndex charIndex;
+
+    // 已标注字符区域的缓存图层，标注内容、视图或选择变化时才重画
+    struct AnnotationLayerState {
+        QPoint leftTop;
+        qreal scaleFactor;
+        QSize size;
+        bool propMode;
+        int listSelectedBlock;
+        int selectedBlockIndex;
+        int selectedCharIndex;
+        bool operator ==(AnnotationLayerState const &o) const {
+            return leftTop == o.leftTop && scaleFactor == o.scaleFactor && size == o.size && propMode == o.propMode &&
+                    listSelectedBlock == o.listSelectedBlock && selectedBlockIndex == o.selectedBlockIndex &&
+                    selectedCharIndex == o.selectedCharIndex;
+        }
+    };
+    QImage annotationLayer;
+    AnnotationLayerState annotationLayerState;
+    bool annotationLayerDirty;
+    QHash<QPair<QString, int>, Glyph> glyphCache; // (文字, 字号) -> 排版好的文字
+    AnnotationHistory history;
+    QFutureWatcher<QPair<bool, AnnotationHistory> > historyWatcher;
     bool keepHistoryOnUndo;
     QString historyMergeKey;
 
@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 CONFIG   += c++11
 
@@ -16,7 +16,22 @@ TEMPLATE = app
 
 SOURCES += main.cpp\
         imageviewer.cpp \
-    imageannotation.cpp
+    imageannotation.cpp \
+    imagepyramid.cpp \
+    characterindex.cpp \
+    annotationfile.cpp \
+    imageprefetcher.cpp \
+    annotationwriter.cpp \
+    thumbnailcache.cpp \
+    annotationhistory.cpp
 
 HEADERS  += imageviewer.h \
-    imageannotation.h
+    imageannotation.h \
+    imagepyramid.h \
+    characterindex.h \
+    annotationfile.h \
+    imageprefetcher.h \
+    annotationwriter.h \
+    thumbnailcache.h \
+    annotationhistory.h \
+    quad.h
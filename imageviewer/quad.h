@@ -0,0 +1,210 @@
+#ifndef QUAD_H
+#define QUAD_H
+
+#include <QPointF>
+#include <QPolygonF>
+#include <QRectF>
+#include <QtGlobal>
+
+// 字符框：固定四个点，放在栈上，不像 QPolygonF 那样每个框都要分配内存。
+// 序列化仍然用 QPolygonF，四个点的多边形与 Quad 可以无损互相转换。
+// 计算都是定长的简单循环，不依赖具体指令集，交给编译器展开和向量化
+class Quad {
+public:
+    Quad() {}
+    Quad(QPointF const &p0, QPointF const &p1, QPointF const &p2, QPointF const &p3) {
+        p[0] = p0;
+        p[1] = p1;
+        p[2] = p2;
+        p[3] = p3;
+    }
+    // 字符框总是四个点；万一不足四个点，用最后一个点补齐
+    explicit Quad(QPolygonF const &poly) {
+        int n = qMin(poly.size(), 4);
+        for (int i = 0; i < n; i++)
+            p[i] = poly[i];
+        for (int i = n; i < 4; i++)
+            p[i] = n > 0 ? poly[n - 1] : QPointF();
+    }
+
+    static bool isQuad(QPolygonF const &poly) { return poly.size() == 4; }
+
+    QPolygonF toPolygon() const {
+        QPolygonF poly(4);
+        for (int i = 0; i < 4; i++)
+            poly[i] = p[i];
+        return poly;
+    }
+
+    QPointF &operator [](int i) { return p[i]; }
+    QPointF const &operator [](int i) const { return p[i]; }
+    QPointF const *points() const { return p; }
+
+    // 与 QPolygonF::boundingRect 相同
+    QRectF boundingRect() const {
+        qreal xmin = p[0].x(), xmax = xmin, ymin = p[0].y(), ymax = ymin;
+        for (int i = 1; i < 4; i++) {
+            xmin = qMin(xmin, p[i].x());
+            xmax = qMax(xmax, p[i].x());
+            ymin = qMin(ymin, p[i].y());
+            ymax = qMax(ymax, p[i].y());
+        }
+        return QRectF(xmin, ymin, xmax - xmin, ymax - ymin);
+    }
+
+    // 以第一个点为中心剖分成两个三角形求面积
+    qreal area() const {
+        qreal ax = p[1].x() - p[0].x(), ay = p[1].y() - p[0].y();
+        qreal bx = p[2].x() - p[0].x(), by = p[2].y() - p[0].y();
+        qreal cx = p[3].x() - p[0].x(), cy = p[3].y() - p[0].y();
+        qreal sum = (ax * by - ay * bx) + (bx * cy - by * cx);
+        return qAbs(sum / 2);
+    }
+
+    // 与 QPolygonF::containsPoint(pt, Qt::OddEvenFill) 相同
+    bool containsPoint(QPointF const &pt) const {
+        bool inside = false;
+        for (int i = 0; i < 4; i++) {
+            QPointF const &a(p[i]);
+            QPointF const &b(p[(i + 1) & 3]);
+            qreal x1 = a.x(), y1 = a.y(), x2 = b.x(), y2 = b.y();
+            if (qFuzzyCompare(y1, y2))
+                continue; // 水平边不计
+            if (y2 < y1) {
+                qSwap(x1, x2);
+                qSwap(y1, y2);
+            }
+            if (pt.y() >= y1 && pt.y() < y2 && x1 + (x2 - x1) / (y2 - y1) * (pt.y() - y1) <= pt.x())
+                inside = !inside;
+        }
+        return inside;
+    }
+
+    // 各个顶点处转向相同（允许三点共线）且面积不为 0
+    bool isConvex() const {
+        int sign = 0;
+        for (int i = 0; i < 4; i++) {
+            qreal c = cross(p[i], p[(i + 1) & 3], p[(i + 2) & 3]);
+            int s = c > 0 ? 1 : c < 0 ? -1 : 0;
+            if (s == 0)
+                continue;
+            if (sign != 0 && s != sign)
+                return false;
+            sign = s;
+        }
+        return sign != 0;
+    }
+
+    // 与 other 相交部分的面积。两个都是凸四边形时在栈上用 Sutherland–Hodgman 裁剪，不分配内存；
+    // 凹、自交或退化的四边形退回 QPolygonF::intersected，结果与以前相同
+    qreal intersectedArea(Quad const &other) const {
+        qreal area;
+        if (isConvex() && other.isConvex() && clippedArea(other, area))
+            return area;
+        return polygonArea(toPolygon().intersected(other.toPolygon()));
+    }
+
+    // 每条边的两个三等分点的包围盒，比四个顶点的包围盒更贴近透视变形后的字
+    QRectF adjustedBoundingRect() const {
+        QPointF q[8];
+        for (int i = 0; i < 4; i++) {
+            QPointF const &p1(p[i]);
+            QPointF const &p2(p[(i + 1) & 3]);
+            for (int j = 1; j < 3; j++)
+                q[i * 2 + j - 1] = p1 * j / 3 + p2 * (3 - j) / 3;
+        }
+        qreal xmin = q[0].x(), xmax = xmin, ymin = q[0].y(), ymax = ymin;
+        for (int i = 1; i < 8; i++) {
+            xmin = qMin(xmin, q[i].x());
+            xmax = qMax(xmax, q[i].x());
+            ymin = qMin(ymin, q[i].y());
+            ymax = qMax(ymax, q[i].y());
+        }
+        return QRectF(xmin, ymin, xmax - xmin, ymax - ymin);
+    }
+
+    // p * scale + offset
+    Quad transformed(qreal scale, QPointF const &offset) const {
+        Quad res;
+        for (int i = 0; i < 4; i++)
+            res.p[i] = QPointF(p[i].x() * scale + offset.x(), p[i].y() * scale + offset.y());
+        return res;
+    }
+
+    // 批量计算，in 和 out 各有 n 个元素
+    static void boundingRects(Quad const *in, int n, QRectF *out) {
+        for (int i = 0; i < n; i++)
+            out[i] = in[i].boundingRect();
+    }
+    static void areas(Quad const *in, int n, qreal *out) {
+        for (int i = 0; i < n; i++)
+            out[i] = in[i].area();
+    }
+    static void transform(Quad const *in, int n, qreal scale, QPointF const &offset, Quad *out) {
+        for (int i = 0; i < n; i++)
+            out[i] = in[i].transformed(scale, offset);
+    }
+
+    // 一般多边形的面积，首尾是否重复都可以
+    static qreal polygonArea(QPolygonF const &poly) {
+        return qAbs(signedArea(poly.constData(), poly.size())) / 2;
+    }
+
+private:
+    enum { MAX_CLIPPED = 16 }; // 凸多边形每次裁剪最多多一个点，留出余量给舍入误差
+
+    static qreal cross(QPointF const &o, QPointF const &a, QPointF const &b) {
+        return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+    }
+
+    // 两倍的有向面积
+    static qreal signedArea(QPointF const *q, int n) {
+        qreal sum = 0;
+        for (int i = 0; i < n; i++) {
+            QPointF const &a(q[i]);
+            QPointF const &b(q[(i + 1) % n]);
+            sum += a.x() * b.y() - a.y() * b.x();
+        }
+        return sum;
+    }
+
+    // 用 other 的四条边依次裁剪本四边形；点数超出缓冲区时返回 false
+    bool clippedArea(Quad const &other, qreal &area) const {
+        QPointF buffer[2][MAX_CLIPPED];
+        QPointF *in = buffer[0], *out = buffer[1];
+        int n = 4;
+        for (int i = 0; i < 4; i++)
+            in[i] = p[i];
+        qreal orientation = signedArea(other.p, 4) > 0 ? 1 : -1;
+        for (int e = 0; e < 4 && n > 0; e++) {
+            QPointF const &a(other.p[e]);
+            QPointF const &b(other.p[(e + 1) & 3]);
+            int m = 0;
+            for (int i = 0; i < n; i++) {
+                QPointF const &u(in[i]);
+                QPointF const &v(in[(i + 1) % n]);
+                qreal cu = cross(a, b, u) * orientation;
+                qreal cv = cross(a, b, v) * orientation;
+                if (m + 2 > MAX_CLIPPED)
+                    return false;
+                if (cu >= 0)
+                    out[m++] = u;
+                if ((cu >= 0) != (cv >= 0)) {
+                    qreal t = cu / (cu - cv);
+                    out[m++] = QPointF(u.x() + (v.x() - u.x()) * t, u.y() + (v.y() - u.y()) * t);
+                }
+            }
+            qSwap(in, out);
+            n = m;
+        }
+        area = n >= 3 ? qAbs(signedArea(in, n)) / 2 : 0;
+        return true;
+    }
+
+private:
+    QPointF p[4];
+};
+
+Q_DECLARE_TYPEINFO(Quad, Q_MOVABLE_TYPE);
+
+#endif // QUAD_H
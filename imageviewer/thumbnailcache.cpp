@@ -0,0 +1,70 @@
+#include <QtConcurrent>
+#include "thumbnailcache.h"
+
+/// ThumbnailCache
+
+ThumbnailCache::ThumbnailCache(QObject *parent)
+    : QObject(parent), generatingFor(0)
+{
+    connect(&watcher, SIGNAL(finished()), this, SLOT(onGenerated()));
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    watcher.waitForFinished();
+}
+
+void ThumbnailCache::setImage(QImage const &image) {
+    this->image = image;
+    cache.clear();
+    pending.clear();
+}
+
+QImage ThumbnailCache::thumbnail(Key const &key, QRect const &bound, int size) {
+    QHash<Key, Thumbnail>::const_iterator it = cache.constFind(key);
+    if (it != cache.constEnd() && it.value().bound == bound) {
+        if (it.value().size == size)
+            return it.value().image;
+        // 只是尺寸变了，先用旧的缩略图顶替
+        Request request = {key, bound, size};
+        pending.append(request);
+        return it.value().image.scaled(QSize(size, size), Qt::IgnoreAspectRatio, Qt::FastTransformation);
+    }
+    Request request = {key, bound, size};
+    pending.append(request);
+    return image.copy(bound).scaled(QSize(size, size), Qt::IgnoreAspectRatio, Qt::FastTransformation);
+}
+
+void ThumbnailCache::generatePending() {
+    if (watcher.isRunning()) {
+        // 上一批完成后会触发重绘，届时再登记
+        pending.clear();
+        return;
+    }
+    if (pending.isEmpty())
+        return;
+    generatingFor = image.cacheKey();
+    watcher.setFuture(QtConcurrent::run(&ThumbnailCache::generate, image, pending));
+    pending.clear();
+}
+
+void ThumbnailCache::onGenerated() {
+    if (generatingFor == image.cacheKey()) { // 期间换了图片则丢弃
+        QVector<QPair<Key, Thumbnail> > result = watcher.result();
+        for (int i = 0; i < result.size(); i++)
+            cache.insert(result[i].first, result[i].second);
+    }
+    emit updated();
+}
+
+QVector<QPair<ThumbnailCache::Key, ThumbnailCache::Thumbnail> > ThumbnailCache::generate(QImage image, QVector<Request> requests) {
+    QVector<QPair<Key, Thumbnail> > result;
+    foreach (Request const &request, requests) {
+        Thumbnail thumbnail;
+        thumbnail.bound = request.bound;
+        thumbnail.size = request.size;
+        thumbnail.image = image.copy(request.bound).scaled(QSize(request.size, request.size),
+                                                           Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        result.append(qMakePair(request.key, thumbnail));
+    }
+    return result;
+}
@@ -0,0 +1,60 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QObject>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include <QImage>
+#include <QRect>
+#include <QFutureWatcher>
+
+// 属性检查视图中每个字的缩略图缓存。缩略图在后台平滑缩放，
+// 只有字的包围方框或显示尺寸变化时才重新生成
+class ThumbnailCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef QPair<int, int> Key; // (block, character)
+
+    struct Request {
+        Key key;
+        QRect bound; // 原图中要裁剪的区域
+        int size;    // 缩略图边长
+    };
+
+    struct Thumbnail {
+        QRect bound;
+        int size;
+        QImage image;
+    };
+
+public:
+    ThumbnailCache(QObject *parent = 0);
+    ~ThumbnailCache();
+
+    void setImage(QImage const &image);
+    // 返回缩略图。缓存未命中时立即返回一张快速缩放的替代图，并登记到后台生成
+    QImage thumbnail(Key const &key, QRect const &bound, int size);
+    // 把本次绘制中未命中的缩略图交给后台生成
+    void generatePending();
+
+signals:
+    void updated();
+
+private slots:
+    void onGenerated();
+
+private:
+    static QVector<QPair<Key, Thumbnail> > generate(QImage image, QVector<Request> requests);
+
+private:
+    QImage image;
+    QHash<Key, Thumbnail> cache;
+    QVector<Request> pending;
+    QFutureWatcher<QVector<QPair<Key, Thumbnail> > > watcher;
+    qint64 generatingFor; // 正在为哪张图片生成（cacheKey）
+};
+
+#endif // THUMBNAILCACHE_H
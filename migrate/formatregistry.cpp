@@ -0,0 +1,102 @@
+#include <QDataStream>
+#include "../imageviewer/annotationfile.h"
+#include "formatregistry.h"
+
+// 0x1000 和 0x1001 的字没有属性，0x1000 没有焦点；其余与 0x1002 相同
+static bool readLegacyAnnotation(QDataStream &stream, ImageAnnotation &anno) {
+    quint32 version;
+    stream >> version;
+    if (version != 0x1000 && version != 0x1001) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return false;
+    }
+    QDataStream::Version streamVersion = static_cast<QDataStream::Version>(stream.version());
+    stream.setVersion(QDataStream::Qt_5_2);
+    anno = ImageAnnotation();
+    quint32 numBlock;
+    stream >> numBlock;
+    for (quint32 i = 0; i < numBlock && stream.status() == QDataStream::Ok; i++) {
+        BlockAnnotation block;
+        quint32 numChar;
+        stream >> numChar;
+        for (quint32 j = 0; j < numChar && stream.status() == QDataStream::Ok; j++) {
+            CharacterAnnotation ch;
+            stream >> ch.box;
+            stream >> ch.text;
+            block.characters.append(ch);
+        }
+        quint32 helperType;
+        stream >> helperType;
+        block.helperType = static_cast<BlockAnnotation::HelperType>(helperType);
+        stream >> block.perspectiveHelper;
+        anno.blocks.append(block);
+    }
+    if (version == 0x1001)
+        stream >> anno.focusPoint;
+    stream.setVersion(streamVersion);
+    return stream.status() == QDataStream::Ok;
+}
+
+// ImageAnnotation，之后是未压缩的 QVector<ImageAnnotation> 历史记录
+static bool readLegacy(QByteArray const &data, FormatRegistry::Content &content) {
+    QDataStream stream(data);
+    if (!readLegacyAnnotation(stream, content.anno))
+        return false;
+    quint32 numHistory;
+    stream >> numHistory;
+    content.history.clear();
+    for (quint32 i = 0; i < numHistory && stream.status() == QDataStream::Ok; i++) {
+        ImageAnnotation anno;
+        if (!readLegacyAnnotation(stream, anno))
+            return false;
+        content.history.push(anno);
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+// 0x1002 之后的格式都由 AnnotationFile 读取；迁移时不接受损坏的历史记录
+static bool readCurrent(QByteArray const &data, FormatRegistry::Content &content) {
+    if (AnnotationFile::parse(data, content.anno, content.history) != AnnotationFile::Ok)
+        return false;
+    return content.history.decode();
+}
+
+static QByteArray writeSectioned(FormatRegistry::Content const &content) {
+    QByteArray data;
+    AnnotationFile::serialize(content.anno, content.history, data); // 读取时已解码，不会失败
+    return data;
+}
+
+/// FormatRegistry
+
+QVector<FormatRegistry::Format> const &FormatRegistry::formats() {
+    static QVector<Format> const registry = {
+        {0x1000, "0x1000 (no focus point)", readLegacy, nullptr},
+        {0x1001, "0x1001 (no character props)", readLegacy, nullptr},
+        {ImageAnnotation::VERSION, "0x1002", readCurrent, nullptr},
+        {AnnotationFile::JOURNAL_VERSION, "0x1003 (journal)", readCurrent, nullptr},
+        {AnnotationFile::SECTIONED_VERSION, "0x1004 (sectioned)", readCurrent, writeSectioned},
+    };
+    return registry;
+}
+
+FormatRegistry::Format const *FormatRegistry::find(quint32 version) {
+    QVector<Format> const &all(formats());
+    for (int i = 0; i < all.size(); i++)
+        if (all[i].version == version)
+            return &all[i];
+    return nullptr;
+}
+
+FormatRegistry::Format const &FormatRegistry::latest() {
+    return formats().last();
+}
+
+quint32 FormatRegistry::versionOf(QByteArray const &data) {
+    if (data.size() < 4)
+        return 0;
+    QDataStream stream(data);
+    quint32 version;
+    stream >> version;
+    return version;
+}
@@ -0,0 +1,36 @@
+#ifndef FORMATREGISTRY_H
+#define FORMATREGISTRY_H
+
+#include <QByteArray>
+#include <QVector>
+#include "../imageviewer/imageannotation.h"
+#include "../imageviewer/annotationhistory.h"
+
+// .stream 各版本的读写。文件开头的 quint32 就是版本号：
+// 0x1000、0x1001、0x1002 是 ImageAnnotation 的版本号，0x1003 起是 AnnotationFile 的版本号。
+// 格式升级时在 formats() 中加一项，写入函数只有最新的版本需要
+class FormatRegistry {
+public:
+    struct Content {
+        ImageAnnotation anno;
+        AnnotationHistory history; // 已解码
+    };
+    typedef bool (*Reader)(QByteArray const &data, Content &content);
+    typedef QByteArray (*Writer)(Content const &content);
+
+    struct Format {
+        quint32 version;
+        char const *name;
+        Reader read;
+        Writer write; // 为空表示只能读取
+    };
+
+public:
+    static QVector<Format> const &formats();
+    static Format const *find(quint32 version); // 不认识的版本返回 nullptr
+    static Format const &latest();
+    // 文件开头的版本号，不足四个字节时返回 0
+    static quint32 versionOf(QByteArray const &data);
+};
+
+#endif // FORMATREGISTRY_H
@@ -0,0 +1,181 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QSet>
+#include <QMap>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <functional>
+#include "../datasetwalker/datasetwalker.h"
+#include "formatregistry.h"
+
+static QTextStream cout(stdout);
+
+enum { PROGRESS_INTERVAL = 1000 }; // 每处理这么多文件输出一次进度
+
+struct Migrated {
+    Migrated() : ok(false), skipped(false), resumed(false), version(0), sizeBefore(0), sizeAfter(0) {}
+    bool ok;
+    bool skipped;       // 不是 .stream
+    bool resumed;       // 断点日志中已记录完成
+    QString errorMessage;
+    quint32 version;    // 原来的版本，已是最新版本时不重写
+    qint64 sizeBefore;
+    qint64 sizeAfter;
+};
+
+static QString versionName(quint32 version) {
+    FormatRegistry::Format const *format = FormatRegistry::find(version);
+    return format ? QString(format->name) : QString("0x%1").arg(version, 4, 16, QChar('0'));
+}
+
+// 读入整个文件，按开头的版本号找到读取函数，用最新版本重写。
+// QSaveFile 先写临时文件，commit 时才替换原文件，中途失败不影响原文件
+static Migrated migrate(QString const &filePath, QSet<QString> const &done) {
+    Migrated res;
+    if (!filePath.endsWith(".stream")) {
+        res.ok = res.skipped = true;
+        return res;
+    }
+    if (done.contains(QFileInfo(filePath).absoluteFilePath())) {
+        res.ok = res.resumed = true;
+        return res;
+    }
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        res.errorMessage = "open failed: " + filePath;
+        return res;
+    }
+    QByteArray data(file.readAll());
+    file.close();
+    res.sizeBefore = res.sizeAfter = data.size();
+    res.version = FormatRegistry::versionOf(data);
+    FormatRegistry::Format const &latest(FormatRegistry::latest());
+    if (res.version == latest.version) {
+        res.ok = true;
+        return res;
+    }
+    FormatRegistry::Format const *format = FormatRegistry::find(res.version);
+    if (!format) {
+        res.errorMessage = QString("unknown version %1: %2").arg(versionName(res.version), filePath);
+        return res;
+    }
+    FormatRegistry::Content content;
+    if (!format->read(data, content)) {
+        res.errorMessage = QString("stream is bad (%1): %2").arg(format->name, filePath);
+        return res;
+    }
+    QByteArray output(latest.write(content));
+    QSaveFile saveFile(filePath);
+    if (!saveFile.open(QIODevice::WriteOnly) || saveFile.write(output) != output.size() || !saveFile.commit()) {
+        res.errorMessage = "write failed: " + filePath;
+        return res;
+    }
+    res.sizeAfter = output.size();
+    res.ok = true;
+    return res;
+}
+
+// 把目录下所有 .stream 原地升级到最新格式。
+// 每完成一个文件在断点日志中记一行，中断后再次运行时跳过日志中的文件；全部完成后删除日志
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationVersion("v0.0.1");
+
+    QCommandLineParser parser;
+    QCommandLineOption logOption("log", "Checkpoint log for resuming. Default: .migrate.log in the folder.", "file");
+    parser.addOption(logOption);
+    parser.process(app);
+    const QStringList args = parser.positionalArguments();
+    if (args.size() < 1) {
+        cout << "missing parameter: folder path" << endl;
+        return 1;
+    }
+    QDir rootDir(args[0]);
+    FormatRegistry::Format const &latest(FormatRegistry::latest());
+    QString target = QString::number(latest.version, 16);
+
+    // 日志每行是 "绝对路径\t目标版本"，目标版本不同的记录不算完成
+    QFile logFile(parser.isSet(logOption) ? parser.value(logOption) : rootDir.filePath(".migrate.log"));
+    QSet<QString> done;
+    if (logFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        while (!logFile.atEnd()) {
+            QStringList fields = QString::fromUtf8(logFile.readLine()).trimmed().split('\t');
+            if (fields.size() == 2 && fields[1] == target)
+                done.insert(fields[0]);
+        }
+        logFile.close();
+    }
+    if (!logFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        cout << "cannot write " << logFile.fileName() << endl;
+        return 1;
+    }
+    QTextStream log(&logFile);
+    log.setCodec("UTF-8");
+
+    QElapsedTimer timer;
+    timer.start();
+    int numFile = 0, numResumed = 0, numConverted = 0;
+    qint64 sizeBefore = 0, sizeAfter = 0;
+    QMap<quint32, int> numByVersion;
+    auto report = [&]() {
+        double seconds = qMax(timer.elapsed(), (qint64)1) / 1000.0;
+        cout << QString("%1 files (%2 converted, %3 resumed), %4 MB read in %5 s, %6 files/s, %7 MB/s")
+                .arg(numFile).arg(numConverted).arg(numResumed)
+                .arg(sizeBefore / 1048576.0, 0, 'f', 1).arg(seconds, 0, 'f', 1)
+                .arg((numFile - numResumed) / seconds, 0, 'f', 0).arg(sizeBefore / 1048576.0 / seconds, 0, 'f', 1) << endl;
+    };
+
+    QStringList nameFilters;
+    nameFilters << "*.stream";
+    DatasetWalker walker;
+    QStringList files;
+    bool listed = walker.listFiles(rootDir, nameFilters, files);
+    cout << files.size() << " files, target version " << latest.name << endl;
+    // 各文件互不相关，先处理完的先记入日志
+    std::function<Migrated(QString const &)> map([&done](QString const &filePath) {
+        return migrate(filePath, done);
+    });
+    std::function<bool(QString const &, Migrated const &)> reduce([&](QString const &filePath, Migrated const &res) {
+        if (res.skipped)
+            return true;
+        if (!res.ok) {
+            cout << res.errorMessage << endl;
+            return false;
+        }
+        numFile++;
+        if (res.resumed) {
+            numResumed++;
+        } else {
+            numByVersion[res.version]++;
+            if (res.version != latest.version)
+                numConverted++;
+            sizeBefore += res.sizeBefore;
+            sizeAfter += res.sizeAfter;
+            log << QFileInfo(filePath).absoluteFilePath() << '\t' << target << '\n';
+            log.flush();
+        }
+        if (numFile % PROGRESS_INTERVAL == 0)
+            report();
+        return true;
+    });
+    bool ok = walker.mapReduce(files, map, reduce, DatasetWalker::Unordered);
+    if (ok && !listed) {
+        cout << walker.errorString() << endl;
+        ok = false;
+    }
+    logFile.close();
+    for (QMap<quint32, int>::const_iterator it = numByVersion.constBegin(); it != numByVersion.constEnd(); ++it)
+        cout << QString("%1 %2").arg(it.value(), 7).arg(versionName(it.key())) << endl;
+    report();
+    cout << sizeBefore << " -> " << sizeAfter << " bytes" << endl;
+    if (!ok) {
+        cout << "error occurred, rerun to resume" << endl;
+        return 1;
+    }
+    logFile.remove();
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+QT += core
+# QT -= gui
+
+CONFIG += c++11
+
+TARGET = migrate
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    formatregistry.cpp \
+    ../imageviewer/imageannotation.cpp \
+    ../imageviewer/annotationhistory.cpp \
+    ../imageviewer/annotationfile.cpp
+
+HEADERS += \
+    formatregistry.h
+
+include(../datasetwalker/datasetwalker.pri)
@@ -0,0 +1,14 @@
+QT += core gui
+
+CONFIG += c++11
+
+TARGET = bench_quad
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += main.cpp
+
+HEADERS += \
+    ../quadsamples.h
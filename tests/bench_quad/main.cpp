@@ -0,0 +1,52 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+#include "../quadsamples.h"
+
+static QTextStream cout(stdout);
+
+// 比较 Quad::intersectedArea 和 QPolygonF::intersected 求交集面积的速度。
+// 样本与 feedback 中的字框相当：两两之间有的相交，有的不相交
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationVersion("v0.0.1");
+
+    QCommandLineParser parser;
+    QCommandLineOption countOption("n", "Number of quad pairs. Default: 100000.", "count", "100000");
+    QCommandLineOption spreadOption("spread", "Range of quad centers. Default: 100.", "pixels", "100");
+    parser.addOption(countOption);
+    parser.addOption(spreadOption);
+    parser.process(app);
+    int n = qMax(parser.value(countOption).toInt(), 1);
+    qreal spread = qMax(parser.value(spreadOption).toDouble(), 1.0);
+
+    QuadSamples samples(1);
+    QVector<Quad> a(n), b(n);
+    for (int i = 0; i < n; i++) {
+        a[i] = samples.convex(spread, i & 1);
+        b[i] = samples.convex(spread, i & 2);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    qreal sumClipped = 0;
+    for (int i = 0; i < n; i++)
+        sumClipped += a[i].intersectedArea(b[i]);
+    qint64 clipped = timer.nsecsElapsed();
+
+    timer.restart();
+    qreal sumQt = 0;
+    for (int i = 0; i < n; i++)
+        sumQt += QuadSamples::qtIntersectedArea(a[i], b[i]);
+    qint64 qt = timer.nsecsElapsed();
+
+    // 输出面积之和，既能核对结果，也防止循环被优化掉
+    cout << QString("%1 pairs, spread %2").arg(n).arg(spread) << endl;
+    cout << QString("Quad::intersectedArea     %1 ns/pair, sum %2").arg(clipped / (double)n, 0, 'f', 1).arg(sumClipped, 0, 'f', 3) << endl;
+    cout << QString("QPolygonF::intersected    %1 ns/pair, sum %2").arg(qt / (double)n, 0, 'f', 1).arg(sumQt, 0, 'f', 3) << endl;
+    cout << QString("speedup %1x").arg(qt / (double)qMax(clipped, (qint64)1), 0, 'f', 1) << endl;
+
+    return 0;
+}
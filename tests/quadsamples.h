@@ -0,0 +1,47 @@
+#ifndef QUADSAMPLES_H
+#define QUADSAMPLES_H
+
+#include <QVector>
+#include <QtMath>
+#include <random>
+#include <algorithm>
+#include "../imageviewer/quad.h"
+
+// 测试用的随机凸四边形：圆上按角度排序的四个点经过随机的缩放和错切，clockwise 时倒序。
+// 中心在 [0, spread) 内，大小与字框相当
+class QuadSamples {
+public:
+    explicit QuadSamples(unsigned seed) : random(seed) {}
+
+    Quad convex(qreal spread, bool clockwise) {
+        std::uniform_real_distribution<qreal> position(0, spread);
+        std::uniform_real_distribution<qreal> radius(5, 40);
+        std::uniform_real_distribution<qreal> angle(0, 2 * M_PI);
+        std::uniform_real_distribution<qreal> scale(0.3, 1.5);
+        std::uniform_real_distribution<qreal> shear(-0.5, 0.5);
+        QPointF center(position(random), position(random));
+        qreal r = radius(random);
+        qreal sx = scale(random), sy = scale(random), k = shear(random);
+        qreal angles[4];
+        for (int i = 0; i < 4; i++)
+            angles[i] = angle(random);
+        std::sort(angles, angles + 4);
+        // 圆上的四个点经过仿射变换仍是凸四边形
+        Quad q;
+        for (int i = 0; i < 4; i++) {
+            qreal x = r * qCos(angles[i]), y = r * qSin(angles[i]);
+            q[clockwise ? 3 - i : i] = center + QPointF(sx * x + k * y, sy * y);
+        }
+        return q;
+    }
+
+    // 与 QPolygonF::intersected 相同的旧算法
+    static qreal qtIntersectedArea(Quad const &a, Quad const &b) {
+        return Quad::polygonArea(a.toPolygon().intersected(b.toPolygon()));
+    }
+
+private:
+    std::mt19937 random;
+};
+
+#endif // QUADSAMPLES_H
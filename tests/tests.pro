@@ -0,0 +1,6 @@
+# 单元测试和性能测试，与批处理工具一起构建；make check 运行单元测试
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    tst_quad \
+    bench_quad
@@ -0,0 +1,100 @@
+#include <QtTest>
+#include "../quadsamples.h"
+
+Q_DECLARE_METATYPE(Quad)
+
+// Quad::intersectedArea 与 QPolygonF::intersected 的结果对比
+class TestQuad : public QObject {
+    Q_OBJECT
+
+private slots:
+    void convexMatchesQt_data();
+    void convexMatchesQt();
+    void fallbackMatchesQt_data();
+    void fallbackMatchesQt();
+    void isConvex();
+    void disjointAndContained();
+};
+
+// 结果一致时返回空串，否则返回两边的数值
+static QString differenceFromQt(Quad const &a, Quad const &b) {
+    qreal expected = QuadSamples::qtIntersectedArea(a, b);
+    qreal actual = a.intersectedArea(b);
+    // 两种裁剪的舍入误差不同，按面积的相对误差比较
+    qreal tolerance = 1e-6 * qMax((qreal)1, qMax(a.area(), b.area()));
+    if (qAbs(actual - expected) <= tolerance)
+        return QString();
+    return QString("actual %1, expected %2").arg(actual, 0, 'g', 17).arg(expected, 0, 'g', 17);
+}
+
+void TestQuad::convexMatchesQt_data() {
+    QTest::addColumn<bool>("clockwiseA");
+    QTest::addColumn<bool>("clockwiseB");
+    QTest::newRow("ccw-ccw") << false << false;
+    QTest::newRow("ccw-cw") << false << true;
+    QTest::newRow("cw-ccw") << true << false;
+    QTest::newRow("cw-cw") << true << true;
+}
+
+void TestQuad::convexMatchesQt() {
+    QFETCH(bool, clockwiseA);
+    QFETCH(bool, clockwiseB);
+    QuadSamples samples(12345);
+    int overlapped = 0;
+    for (int i = 0; i < 5000; i++) {
+        Quad a = samples.convex(60, clockwiseA);
+        Quad b = samples.convex(60, clockwiseB);
+        QVERIFY(a.isConvex() || a.area() < 1e-6);
+        QString difference = differenceFromQt(a, b);
+        QVERIFY2(difference.isEmpty(), qPrintable(QString("sample %1: %2").arg(i).arg(difference)));
+        if (a.intersectedArea(b) > 0)
+            overlapped++;
+    }
+    // 保证大部分样本真正走到了裁剪
+    QVERIFY(overlapped > 1000);
+}
+
+void TestQuad::fallbackMatchesQt_data() {
+    QTest::addColumn<Quad>("a");
+    QTest::addColumn<Quad>("b");
+    Quad square(QPointF(0, 0), QPointF(10, 0), QPointF(10, 10), QPointF(0, 10));
+    QTest::newRow("collinear") << Quad(QPointF(0, 0), QPointF(5, 5), QPointF(10, 10), QPointF(2, 2)) << square;
+    QTest::newRow("repeated") << Quad(QPointF(3, 3), QPointF(3, 3), QPointF(3, 3), QPointF(3, 3)) << square;
+    QTest::newRow("triangle") << Quad(QPointF(2, 2), QPointF(12, 2), QPointF(12, 2), QPointF(2, 12)) << square;
+    QTest::newRow("concave") << Quad(QPointF(0, 0), QPointF(12, 6), QPointF(0, 12), QPointF(4, 6)) << square;
+    QTest::newRow("bowtie") << Quad(QPointF(-2, -2), QPointF(12, 12), QPointF(12, -2), QPointF(-2, 12)) << square;
+    QTest::newRow("both-degenerate") << Quad(QPointF(1, 1), QPointF(1, 1), QPointF(9, 9), QPointF(9, 9))
+                                     << Quad(QPointF(0, 5), QPointF(10, 5), QPointF(10, 5), QPointF(0, 5));
+}
+
+void TestQuad::fallbackMatchesQt() {
+    QFETCH(Quad, a);
+    QFETCH(Quad, b);
+    QString difference = differenceFromQt(a, b);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+    difference = differenceFromQt(b, a);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+}
+
+void TestQuad::isConvex() {
+    QVERIFY(Quad(QPointF(0, 0), QPointF(10, 0), QPointF(10, 10), QPointF(0, 10)).isConvex());
+    QVERIFY(Quad(QPointF(0, 10), QPointF(10, 10), QPointF(10, 0), QPointF(0, 0)).isConvex());
+    QVERIFY(Quad(QPointF(0, 0), QPointF(5, 0), QPointF(10, 0), QPointF(5, 5)).isConvex());
+    QVERIFY(!Quad(QPointF(0, 0), QPointF(12, 6), QPointF(0, 12), QPointF(4, 6)).isConvex());
+    QVERIFY(!Quad(QPointF(0, 0), QPointF(10, 10), QPointF(10, 0), QPointF(0, 10)).isConvex());
+    QVERIFY(!Quad(QPointF(0, 0), QPointF(5, 5), QPointF(10, 10), QPointF(2, 2)).isConvex());
+}
+
+void TestQuad::disjointAndContained() {
+    Quad square(QPointF(0, 0), QPointF(10, 0), QPointF(10, 10), QPointF(0, 10));
+    Quad inner(QPointF(2, 2), QPointF(4, 2), QPointF(4, 4), QPointF(2, 4));
+    Quad far(QPointF(20, 20), QPointF(30, 20), QPointF(30, 30), QPointF(20, 30));
+    QCOMPARE(square.intersectedArea(inner), 4.0);
+    QCOMPARE(inner.intersectedArea(square), 4.0);
+    QCOMPARE(square.intersectedArea(far), 0.0);
+    QCOMPARE(square.intersectedArea(square), 100.0);
+}
+
+QTEST_APPLESS_MAIN(TestQuad)
+
+#include "tst_quad.moc"
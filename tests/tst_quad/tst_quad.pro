@@ -0,0 +1,14 @@
+QT += core gui testlib
+
+CONFIG += c++11
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_quad
+
+TEMPLATE = app
+
+SOURCES += tst_quad.cpp
+
+HEADERS += \
+    ../quadsamples.h
@@ -0,0 +1,19 @@
+# 批处理工具，共用 datasetwalker 静态库；tests 是 Quad 的单元测试和性能测试
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    datasetwalker \
+    charcount \
+    compactstream \
+    convertjson \
+    fixdataapply02 \
+    fixdatacharcount \
+    migrate \
+    tests
+
+charcount.depends = datasetwalker
+compactstream.depends = datasetwalker
+convertjson.depends = datasetwalker
+fixdataapply02.depends = datasetwalker
+fixdatacharcount.depends = datasetwalker
+migrate.depends = datasetwalker
@@ -5,9 +5,13 @@
 #include <QJsonArray>
 #include <QFile>
 #include <QDataStream>
+#include <QtMath>
 #include <QDebug>
 #include <queue>
+#include <algorithm>
 #include "../imageviewer/imageannotation.h"
+#include "../imageviewer/quad.h"
+#include "../imageviewer/annotationfile.h"
 
 static QTextStream cin(stdin);
 static QTextStream cout(stdout);
@@ -51,10 +55,9 @@ QJsonObject validateSingle(QString b64str, QMap<QString, QVector<CharacterAnnota
             res["errorMessage"] = QCoreApplication::tr("bytearray is bad");
             return res;
         }
-        QDataStream st(&fileContent, QIODevice::ReadOnly);
+        // 只读取标注段，不解析历史记录
         ImageAnnotation anno;
-        st >> anno;
-        if (st.status() != QDataStream::Ok) {
+        if (!AnnotationFile::parseAnnotation(fileContent, anno)) {
             res["error"] = 4;
             res["errorMessage"] = QCoreApplication::tr("stream is bad");
             return res;
@@ -94,11 +97,138 @@ struct DistPair {
     qreal distance;
     int i;
     int j;
+    // 距离相同时先取 i 小的，再取 j 小的
     bool operator<(DistPair const &other) const {
-        return distance > other.distance;
+        if (distance != other.distance)
+            return distance > other.distance;
+        if (i != other.i)
+            return i > other.i;
+        return j > other.j;
     }
 };
 
+// 字框都是四边形时用 Quad 的凸四边形裁剪，不分配内存
+qreal intersectedArea(QPolygonF const &a, QPolygonF const &b) {
+    if (Quad::isQuad(a) && Quad::isQuad(b))
+        return Quad(a).intersectedArea(Quad(b));
+    return Quad::polygonArea(a.intersected(b));
+}
+
+// 一次算出所有字框的中心、面积和包围盒的半周长；字框都是四边形，不是时按一般多边形计算。
+// 两个字框的中心的曼哈顿距离超过各自半周长之和时，包围盒不相交
+void boxGeometry(QVector<CharacterAnnotation> const &characters, QVector<QPointF> &center, QVector<qreal> &area,
+                 QVector<qreal> &reach) {
+    int n = characters.size();
+    QVector<Quad> quads(n);
+    for (int i = 0; i < n; i++)
+        quads[i] = Quad(characters[i].box);
+    QVector<QRectF> bounds(n);
+    area.resize(n);
+    Quad::boundingRects(quads.constData(), n, bounds.data());
+    Quad::areas(quads.constData(), n, area.data());
+    center.resize(n);
+    reach.resize(n);
+    for (int i = 0; i < n; i++) {
+        if (!Quad::isQuad(characters[i].box)) {
+            bounds[i] = characters[i].box.boundingRect();
+            area[i] = Quad::polygonArea(characters[i].box);
+        }
+        center[i] = bounds[i].center();
+        reach[i] = (bounds[i].width() + bounds[i].height()) / 2;
+    }
+}
+
+// 参考字框中心的均匀网格，格子的边长约为一个字，按格子由近及远查找最近的还没有配对的字框
+class ReferenceGrid {
+public:
+    ReferenceGrid(QVector<QPointF> const &centers, QVector<qreal> const &reach)
+        : centers(centers), originX(0), originY(0), size(1), cols(1), rows(1) {
+        int n = centers.size();
+        if (n == 0) {
+            cells.resize(1);
+            return;
+        }
+        qreal maxX = centers[0].x(), maxY = centers[0].y();
+        originX = maxX;
+        originY = maxY;
+        qreal sum = 0;
+        for (int j = 0; j < n; j++) {
+            originX = qMin(originX, centers[j].x());
+            originY = qMin(originY, centers[j].y());
+            maxX = qMax(maxX, centers[j].x());
+            maxY = qMax(maxY, centers[j].y());
+            sum += reach[j];
+        }
+        qreal width = maxX - originX, height = maxY - originY;
+        size = sum / n;
+        // 个别离得很远的字框不能让格子数失控，格子数不超过字框数的几倍
+        size = qMax(size, qSqrt(width * height / (MAX_CELLS_PER_BOX * n)));
+        size = qMax(size, qMax(width, height) / (MAX_CELLS_PER_BOX * n));
+        if (!(size > 0))
+            size = 1;
+        cols = (int)(width / size) + 1;
+        rows = (int)(height / size) + 1;
+        cells.resize(cols * rows);
+        for (int j = 0; j < n; j++)
+            cells[cellOf(centers[j])].append(j);
+    }
+
+    // 曼哈顿距离不超过 limit 的最近的点，距离相同时取下标小的；没有时返回 -1
+    int nearest(QPointF const &p, qreal limit, qreal &distance) const {
+        int cx = column(p.x()), cy = row(p.y());
+        int best = -1;
+        // 第 r 圈格子中的点与 p 的距离不小于 (r - 1) * size
+        for (int r = 0; r <= cols || r <= rows; r++) {
+            qreal bound = (r - 1) * size;
+            if (bound > limit || (best >= 0 && bound > distance))
+                break;
+            for (int y = cy - r; y <= cy + r; y++) {
+                if (y < 0 || y >= rows)
+                    continue;
+                int step = (y == cy - r || y == cy + r) ? 1 : 2 * r;
+                for (int x = cx - r; x <= cx + r; x += step) {
+                    if (x < 0 || x >= cols)
+                        continue;
+                    foreach (int j, cells[y * cols + x]) {
+                        qreal d = (p - centers[j]).manhattanLength();
+                        if (d > limit)
+                            continue;
+                        if (best < 0 || d < distance || (d == distance && j < best)) {
+                            best = j;
+                            distance = d;
+                        }
+                    }
+                }
+            }
+        }
+        return best;
+    }
+
+    void remove(int j) {
+        cells[cellOf(centers[j])].removeOne(j);
+    }
+
+private:
+    enum { MAX_CELLS_PER_BOX = 4 };
+
+    int column(qreal x) const {
+        return qBound(0, (int)qFloor((x - originX) / size), cols - 1);
+    }
+    int row(qreal y) const {
+        return qBound(0, (int)qFloor((y - originY) / size), rows - 1);
+    }
+    int cellOf(QPointF const &p) const {
+        return row(p.y()) * cols + column(p.x());
+    }
+
+private:
+    QVector<QPointF> const &centers;
+    qreal originX, originY;
+    qreal size;
+    int cols, rows;
+    QVector<QVector<int> > cells;
+};
+
 QJsonObject feedback(QMap<QString, QVector<CharacterAnnotation> > images, QMap<QString, QVector<CharacterAnnotation> > reference, qreal ratio) {
     QJsonObject res;
     QJsonObject feed, feed_ref;
@@ -108,33 +238,30 @@ QJsonObject feedback(QMap<QString, QVector<CharacterAnnotation> > images, QMap<Q
             continue;
         }
         QJsonObject json, json_ref;
-        QVector<QPointF> center;
-        QVector<QPointF> center_ref;
-        foreach (CharacterAnnotation const &ch, it.value())
-            center.append(ch.box.boundingRect().center());
-        foreach (CharacterAnnotation const &ch, it_ref.value())
-            center_ref.append(ch.box.boundingRect().center());
-        auto polyArea = [](QPolygonF const &poly) {
-            if (poly.size() < 3)
-                return (qreal)0.0;
-            QPointF o(poly[0]);
-            qreal sum = 0.0;
-            for (int i = 2; i < poly.size(); i++) {
-                QPointF oa = poly[i - 1] - o;
-                QPointF ob = poly[i] - o;
-                qreal cr = oa.x() * ob.y() - oa.y() * ob.x();
-                sum += cr;
-            }
-            return qAbs(sum / 2);
-        };
+        QVector<QPointF> center, center_ref;
+        QVector<qreal> area, area_ref;
+        QVector<qreal> reach, reach_ref;
+        boxGeometry(it.value(), center, area, reach);
+        boxGeometry(it_ref.value(), center_ref, area_ref, reach_ref);
 
+        // 贪心地按距离从近到远配对，配对后再看重叠率。
+        // 每个字只在堆中放它最近的还没有配对的参考字框，取出时那个参考字框已被配对就重新查找，
+        // 配对的顺序与把所有 (i, j) 放进堆中相同。距离超过 limit 的包围盒不相交，重叠率为 0，不影响结果
+        qreal limit = 0;
+        if (!reach.isEmpty() && !reach_ref.isEmpty())
+            limit = *std::max_element(reach.constBegin(), reach.constEnd())
+                    + *std::max_element(reach_ref.constBegin(), reach_ref.constEnd());
+        limit = limit * (1 + 1e-9) + 1e-9;
+        ReferenceGrid grid(center_ref, reach_ref);
         std::priority_queue<DistPair> q;
-        for (int i = 0; i < center.size(); i++) {
-            for (int j = 0; j < center_ref.size(); j++) {
-                qreal distance = (center[i] - center_ref[j]).manhattanLength();
+        auto pushNearest = [&](int i) {
+            qreal distance;
+            int j = grid.nearest(center[i], limit, distance);
+            if (j >= 0)
                 q.push(DistPair({distance, i, j}));
-            }
-        }
+        };
+        for (int i = 0; i < center.size(); i++)
+            pushNearest(i);
         QJsonArray error, miss, reduntant;
         QJsonArray error_ref, miss_ref, reduntant_ref;
         QVector<int> nearToRef(it.value().size(), -1), nearFromRef(it_ref.value().size(), -1);
@@ -144,16 +271,17 @@ QJsonObject feedback(QMap<QString, QVector<CharacterAnnotation> > images, QMap<Q
             q.pop();
             if (nearToRef[p.i] != -1)
                 continue;
-            if (nearFromRef[p.j] != -1)
+            if (nearFromRef[p.j] != -1) {
+                pushNearest(p.i);
                 continue;
+            }
             nearToRef[p.i] = p.j;
             nearFromRef[p.j] = p.i;
+            grid.remove(p.j);
             CharacterAnnotation character = it.value()[p.i];
             CharacterAnnotation character_ref = it_ref.value()[p.j];
-            qreal area = polyArea(character.box);
-            qreal area_ref = polyArea(character_ref.box);
-            qreal intersected = polyArea(character.box.intersected(character_ref.box));
-            qreal overlap_ratio = intersected / (area + area_ref - intersected);
+            qreal intersected = intersectedArea(character.box, character_ref.box);
+            qreal overlap_ratio = intersected / (area[p.i] + area_ref[p.j] - intersected);
             if (overlap_ratio >= 0.20) {
                 matchToRef[p.i] = p.j;
                 matchFromRef[p.j] = p.i;
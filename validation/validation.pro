@@ -10,4 +10,6 @@ CONFIG -= app_bundle
 TEMPLATE = app
 
 SOURCES += main.cpp \
-    ../imageviewer/imageannotation.cpp
+    ../imageviewer/imageannotation.cpp \
+    ../imageviewer/annotationhistory.cpp \
+    ../imageviewer/annotationfile.cpp